@@ -95,10 +95,20 @@ public:
 
         const auto& inputs = problem.InputVariables();
 
+        // the variation operators which maintain the hashes expect sorted parents: the initial population is sorted
+        // once, after which the offspring are kept sorted by the operators themselves
+        auto hashMode = generator.Crossover().MaintainHashes();
+        if (!hashMode.has_value()) {
+            hashMode = generator.Mutator().MaintainHashes();
+        }
+
         auto create = [&](gsl::index i) {
             // create one random generator per thread
             Operon::Random rndlocal{seeds[i]};
             parents[i].Genotype = creator(rndlocal, grammar, inputs);
+            if (hashMode.has_value()) {
+                parents[i].Genotype.Sort(hashMode.value());
+            }
             parents[i][Idx] = Operon::Numeric::Max<Operon::Scalar>();
         };
         const auto& evaluator = generator.Evaluator();
@@ -111,6 +121,8 @@ public:
         ExecutionPolicy executionPolicy;
 
         std::for_each(executionPolicy, indices.begin(), indices.begin() + config.PopulationSize, create);
+        // draw the rows used for local optimization (no-op unless the evaluator is configured to subsample)
+        generator.Evaluator().Resample(random);
         std::for_each(executionPolicy, parents.begin(), parents.end(), evaluate);
 
         // flag to signal algorithm termination
@@ -119,12 +131,16 @@ public:
         auto iterate = [&](gsl::index i) {
             Operon::Random rndlocal{seeds[i]};
 
+            // the offspring is written into the storage of the pool individual it replaces
             while (!(terminate = generator.Terminate())) {
-                if (auto result = generator(rndlocal, config.CrossoverProbability, config.MutationProbability); result.has_value()) {
-                    offspring[i] = std::move(result.value());
+                if (generator.Generate(rndlocal, config.CrossoverProbability, config.MutationProbability, offspring[i])) {
                     return;
                 }
             }
+            // no offspring: the worst possible fitness keeps it out of the population (the reinserters also skip
+            // empty genotypes)
+            offspring[i].Genotype.Nodes().clear();
+            offspring[i][Idx] = Operon::Numeric::Max<Operon::Scalar>();
         };
 
         for (generation = 0; generation < config.Generations; ++generation) {
@@ -151,6 +167,10 @@ public:
 
             offspring[0] = *best;
             generator.Prepare(parents);
+            // refresh the local optimization sample once per generation
+            generator.Evaluator().Resample(random);
+            // keep the node values of the best parents for the incremental evaluation of their offspring
+            generator.Evaluator().Retain(parents, Idx);
             // we always allow one elite (maybe this should be more configurable?)
             std::for_each(executionPolicy, indices.cbegin() + 1, indices.cbegin() + config.PoolSize, iterate);
             // merge pool back into pop
@@ -31,6 +31,14 @@
 
 namespace Operon {
 namespace {
+    // collects the hashes of a tree that is already sorted
+    static inline Operon::Distance::HashVector MakeHashes(const Tree& tree) {
+        Operon::Distance::HashVector hashes(tree.Length());
+        std::transform(std::execution::unseq, tree.Nodes().begin(), tree.Nodes().end(), hashes.begin(), [](const auto& node) { return node.CalculatedHashValue; });
+        std::sort(std::execution::unseq, hashes.begin(), hashes.end());
+        return hashes;
+    }
+
     static inline Operon::Distance::HashVector MakeHashes(Tree& tree, Operon::HashMode mode) {
         Operon::Distance::HashVector hashes(tree.Length());
         tree.Sort(mode);
@@ -48,6 +56,11 @@ public:
         return diversity;
     }
 
+    // the genotypes are kept sorted in hash mode H (by the variation operators, see MaintainHashes, and by the
+    // evaluator, see EvaluatorBase::Sorted), so their hashes are used as they are instead of sorting a copy of each tree
+    void Sorted(bool value) { sorted = value; }
+    bool Sorted() const { return sorted; }
+
     void Prepare(gsl::span<const T> pop)
     {
         hashes.clear();
@@ -60,6 +73,10 @@ public:
 
         // hybrid (strict) hashing
         std::for_each(ep, indices.begin(), indices.end(), [&](gsl::index i) {
+            if (sorted) {
+                hashes[i] = MakeHashes(pop[i].Genotype);
+                return;
+            }
             auto tree = pop[i].Genotype; // make a copy because the tree will be sorted
             hashes[i] = MakeHashes(tree, H);
         });
@@ -90,6 +107,7 @@ public:
 
     private:
         double diversity;
+        bool sorted = false;
         std::vector<Operon::Distance::HashVector> hashes; 
     };
 } // namespace Operon
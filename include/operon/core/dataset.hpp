@@ -26,8 +26,10 @@
 #include <Eigen/Dense>
 #include <Eigen/Eigen>
 #include <algorithm>
+#include <atomic>
 #include <exception>
 #include <fmt/core.h>
+#include <memory>
 #include <numeric>
 #include <unordered_map>
 #include <vector>
@@ -42,24 +44,157 @@ namespace {
 }
 
 class Dataset {
+public:
+    using MatrixType = Eigen::Array<Operon::Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>;
+    // the values are always accessed through a map, which either points to the owned matrix or to a memory-mapped binary file
+    using MapType = Eigen::Map<const MatrixType, Eigen::Unaligned, Eigen::OuterStride<>>;
+    using SingleMatrixType = Eigen::Array<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>;
+
+    // linear transformation applied to a column by Normalize or Standardize: scaled = (original - Offset) / Scale
+    struct Scaling {
+        Operon::Scalar Offset = 0;
+        Operon::Scalar Scale = 1;
+
+        Operon::Scalar Apply(Operon::Scalar original) const noexcept { return (original - Offset) / Scale; }
+        Operon::Scalar Invert(Operon::Scalar scaled) const noexcept { return scaled * Scale + Offset; }
+    };
+
 private:
+    class MappedFile;
+
     std::vector<Variable> variables;
-    using MatrixType = Eigen::Array<Operon::Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>;
     MatrixType values;
+    MapType map { nullptr, 0, 0, Eigen::OuterStride<>(0) };
+    std::shared_ptr<const MappedFile> file; // keeps the mapping alive, shared between copies
+    std::shared_ptr<const SingleMatrixType> single; // optional single precision copy, shared between copies
+    std::vector<Scaling> scaling; // accumulated scaling of each column, empty while no column was scaled
+    uint64_t version = NextVersion(); // identifies the values, see Version()
+
+    // lookup tables from variable hash and name to the position in the variables vector, built once the variables are known
+    // the hash table uses open addressing with linear probing: the variable hashes are uniformly distributed, so their
+    // low bits are used directly as the slot index and a lookup usually touches a single slot
+    std::vector<std::pair<Operon::Hash, gsl::index>> hashIndex;
+    std::unordered_map<std::string, gsl::index> nameIndex;
+
+    friend class DatasetStream;
+
+    Dataset() = default;
+    Dataset(std::vector<Variable> vars, MatrixType vals)
+        : variables(std::move(vars))
+        , values(std::move(vals))
+    {
+        Bind();
+        BuildIndex();
+    }
+
+    void LoadBinary(const std::string& path);
+
+    static uint64_t NextVersion() noexcept
+    {
+        static std::atomic<uint64_t> counter { 0 };
+        return ++counter;
+    }
+
+    // points the map to the owned values
+    void Bind()
+    {
+        new (&map) MapType(values.data(), values.rows(), values.cols(), Eigen::OuterStride<>(values.rows()));
+    }
 
-    Dataset();
+    // replaces a memory-mapped view with a private copy of the values, before they are modified
+    void Detach()
+    {
+        if (file) {
+            values = map;
+            file.reset();
+            Bind();
+        }
+    }
+
+    void BuildIndex()
+    {
+        size_t capacity = 2;
+        while (capacity < 2 * variables.size()) {
+            capacity <<= 1;
+        }
+        hashIndex.assign(capacity, { Operon::Hash { 0 }, gsl::index { -1 } });
+        nameIndex.clear();
+        for (size_t i = 0; i < variables.size(); ++i) {
+            auto slot = variables[i].Hash & (capacity - 1);
+            while (hashIndex[slot].second != -1) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            hashIndex[slot] = { variables[i].Hash, static_cast<gsl::index>(i) };
+            nameIndex[variables[i].Name] = static_cast<gsl::index>(i);
+        }
+    }
+
+    const Variable& FindVariable(Operon::Hash hashValue) const noexcept
+    {
+        auto mask = hashIndex.size() - 1;
+        for (auto slot = hashValue & mask;; slot = (slot + 1) & mask) {
+            auto [hash, i] = hashIndex[slot];
+            Expects(i != -1); // unknown variable
+            if (hash == hashValue) {
+                return variables[i];
+            }
+        }
+    }
+
+    const Variable& FindVariable(const std::string& name) const
+    {
+        auto it = nameIndex.find(name);
+        Expects(it != nameIndex.end()); // unknown variable
+        return variables[it->second];
+    }
+
+    // scales the given columns in place, in parallel, with the parameters returned by f(column values)
+    template <typename F>
+    void Scale(gsl::span<const gsl::index> columns, F&& f);
+
+    // keeps the single precision copy (if any) in sync and gives the dataset a new version after the values were modified
+    void Refresh()
+    {
+        version = NextVersion();
+        if (single) {
+            CacheSinglePrecision();
+        }
+    }
 
 public:
+    // loads a csv file or a binary file created with Save (detected from its contents)
+    // binary files are memory-mapped read-only and their values are not copied
     Dataset(const std::string& file, bool hasHeader = false);
     Dataset(const Dataset& rhs)
         : variables(rhs.variables)
         , values(rhs.values)
+        , file(rhs.file)
+        , single(rhs.single)
+        , scaling(rhs.scaling)
+        , version(rhs.version)
+        , hashIndex(rhs.hashIndex)
+        , nameIndex(rhs.nameIndex)
     {
+        if (file) {
+            new (&map) MapType(rhs.map);
+        } else {
+            Bind();
+        }
     }
     Dataset(Dataset&& rhs) noexcept
-        : variables(rhs.variables)
+        : variables(std::move(rhs.variables))
         , values(std::move(rhs.values))
+        , map(rhs.map)
+        , file(std::move(rhs.file))
+        , single(std::move(rhs.single))
+        , scaling(std::move(rhs.scaling))
+        , version(rhs.version)
+        , hashIndex(std::move(rhs.hashIndex))
+        , nameIndex(std::move(rhs.nameIndex))
     {
+        if (!file) {
+            Bind();
+        }
     }
     Dataset(const std::vector<Variable>& vars, const std::vector<std::vector<Operon::Scalar>>& vals)
         : variables(vars)
@@ -70,6 +205,8 @@ public:
                 values(j, i) = vals[i][j];
             }
         }
+        Bind();
+        BuildIndex();
     }
 
     Dataset& operator=(Dataset rhs)
@@ -82,13 +219,48 @@ public:
     {
         variables.swap(rhs.variables);
         values.swap(rhs.values);
+        file.swap(rhs.file);
+        single.swap(rhs.single);
+        scaling.swap(rhs.scaling);
+        std::swap(version, rhs.version);
+        hashIndex.swap(rhs.hashIndex);
+        nameIndex.swap(rhs.nameIndex);
+        MapType tmp(map);
+        new (&map) MapType(rhs.map);
+        new (&rhs.map) MapType(tmp);
     }
 
-    size_t Rows() const { return values.rows(); }
-    size_t Cols() const { return values.cols(); }
+    // writes the dataset in the binary columnar format:
+    // - a header with the magic bytes, format version, dimensions, column stride and data offset
+    // - the variable table (hash, index and name of each variable)
+    // - the columns, each starting at a 64-byte boundary and padded to the column stride
+    // values are stored in native byte order
+    void Save(const std::string& path) const;
+
+    // identifies the current values: a new dataset gets a process-wide unique version, which changes whenever its
+    // values are modified (eg. by Shuffle or Standardize) and is kept by copies, so that equal versions mean equal values
+    uint64_t Version() const noexcept { return version; }
+
+    // true if the values are a view of a memory-mapped file
+    bool IsMapped() const { return static_cast<bool>(file); }
+
+    // keeps a single precision copy of the values, used by evaluation plans compiled against this dataset
+    // so that Evaluate<float> reads half the bytes and does not have to convert the variable values
+    void CacheSinglePrecision() { single = std::make_shared<const SingleMatrixType>(map.cast<float>()); }
+    void ReleaseSinglePrecision() { single.reset(); }
+    bool HasSinglePrecision() const { return static_cast<bool>(single); }
+
+    // returns the single precision values of the column with the given index (empty if there is no cached copy)
+    const gsl::span<const float> GetSingleValues(gsl::index index) const noexcept
+    {
+        return single ? gsl::span<const float>(single->col(index).data(), single->rows()) : gsl::span<const float>();
+    }
+
+    size_t Rows() const { return map.rows(); }
+    size_t Cols() const { return map.cols(); }
     std::pair<size_t, size_t> Dimensions() const { return { Rows(), Cols() }; }
 
-    const MatrixType& Values() const { return values; }
+    const MapType& Values() const { return map; }
 
     const std::vector<std::string> VariableNames() const
     {
@@ -99,71 +271,106 @@ public:
 
     const gsl::span<const Operon::Scalar> GetValues(const std::string& name) const
     {
-        auto it = std::partition_point(variables.begin(), variables.end(), [&](const auto& v) { return CompareWithSize(v.Name, name); });
-        return gsl::span<const Operon::Scalar>(values.col(it->Index).data(), values.rows());
+        return gsl::span<const Operon::Scalar>(map.col(FindVariable(name).Index).data(), map.rows());
     }
 
     const gsl::span<const Operon::Scalar> GetValues(Operon::Hash hashValue) const noexcept
     {
-        auto it = std::partition_point(variables.begin(), variables.end(), [=](const auto& v) { return v.Hash < hashValue; });
-        return gsl::span<const Operon::Scalar>(values.col(it->Index).data(), values.rows());
+        return gsl::span<const Operon::Scalar>(map.col(FindVariable(hashValue).Index).data(), map.rows());
     }
 
     const gsl::span<const Operon::Scalar> GetValues(gsl::index index) const noexcept
     {
-        return gsl::span<const Operon::Scalar>(values.col(index).data(), values.rows());
+        return gsl::span<const Operon::Scalar>(map.col(index).data(), map.rows());
     }
 
-    const std::string& GetName(Operon::Hash hashValue) const
-    {
-        auto it = std::partition_point(variables.begin(), variables.end(), [=](const auto& v) { return v.Hash < hashValue; });
-        return it->Name;
-    }
+    const std::string& GetName(Operon::Hash hashValue) const { return FindVariable(hashValue).Name; }
     const std::string& GetName(gsl::index index) const { return variables[index].Name; }
 
-    Operon::Hash GetHashValue(const std::string& name) const
-    {
-        auto it = std::partition_point(variables.begin(), variables.end(), [&](const auto& v) { return CompareWithSize(v.Name, name); });
-        return it->Hash;
-    }
+    Operon::Hash GetHashValue(const std::string& name) const { return FindVariable(name).Hash; }
 
-    gsl::index GetIndex(Operon::Hash hashValue) const
-    {
-        auto it = std::partition_point(variables.begin(), variables.end(), [=](const auto& v) { return v.Hash < hashValue; });
-        return it->Index;
-    }
+    gsl::index GetIndex(Operon::Hash hashValue) const { return FindVariable(hashValue).Index; }
     const gsl::span<const Variable> Variables() const { return gsl::span<const Variable>(variables); }
 
-    void Shuffle(Operon::Random& random) 
+    // returns a new dataset (with the same variables and hash values) containing only the given rows, in that order
+    Dataset Subset(gsl::span<const gsl::index> rows) const
     {
-        Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic> perm(values.rows());
-        perm.setIdentity();
-        // generate a random permutation
-        std::shuffle(perm.indices().data(), perm.indices().data() + perm.indices().size(), random);
-        values = perm * values.matrix(); // permute rows
+        MatrixType subset(rows.size(), map.cols());
+        for (gsl::index j = 0; j < map.cols(); ++j) {
+            for (size_t i = 0; i < rows.size(); ++i) {
+                subset(i, j) = map(rows[i], j);
+            }
+        }
+        Dataset ds(variables, std::move(subset));
+        ds.scaling = scaling;
+        if (single) {
+            ds.CacheSinglePrecision();
+        }
+        return ds;
     }
 
-    void Normalize(gsl::index i, Range range) 
+    // returns the scaling applied so far to the column with the given index (the identity if it was never scaled),
+    // so that values or models can be mapped back to the original units
+    Scaling GetScaling(gsl::index index) const noexcept
     {
-        Expects(range.Start() + range.Size() < static_cast<size_t>(values.rows()));
-        auto seg = values.col(i).segment(range.Start(), range.Size());
-        auto min = seg.minCoeff();
-        auto max = seg.maxCoeff();
-        values.col(i) = (values.col(i).array() - min) / (max - min);
+        return scaling.empty() ? Scaling {} : scaling[index];
     }
 
-    // standardize column i using mean and stddev calculated over the specified range
-    void Standardize(gsl::index i, Range range) 
-    {
-        Expects(range.Start() + range.Size() < static_cast<size_t>(values.rows()));
-        auto seg = values.col(i).segment(range.Start(), range.Size());
-        MeanVarianceCalculator calc;
-        auto vals = gsl::span<Operon::Scalar>(seg.data(), seg.size());
-        calc.Reset();
-        calc.Add(vals);
+    // permutes the rows randomly, in place (column by column, in parallel)
+    void Shuffle(Operon::Random& random);
+
+    // scales the given columns to [0, 1] using the min and max calculated over the specified range
+    // (a column that is constant over the range is only shifted to zero, by Standardize as well)
+    void Normalize(gsl::span<const gsl::index> columns, Range range);
+    void Normalize(gsl::index i, Range range) { Normalize({ &i, 1 }, range); }
+
+    // standardizes the given columns using the mean and stddev calculated over the specified range
+    void Standardize(gsl::span<const gsl::index> columns, Range range);
+    void Standardize(gsl::index i, Range range) { Standardize({ &i, 1 }, range); }
+};
+
+// reads a binary dataset (see Dataset::Save) in blocks of rows, for datasets that do not fit in memory
+// the current block is a Dataset with the same variables and a fixed storage of BlockRows() rows, so that
+// evaluation plans compiled against it remain valid when the next block is loaded
+class DatasetStream {
+public:
+    static constexpr size_t DefaultBlockRows = 1UL << 16;
 
-        values.col(i) = (values.col(i).array() - calc.Mean()) / calc.StandardDeviation();
+    explicit DatasetStream(const std::string& path, size_t blockRows = DefaultBlockRows);
+    ~DatasetStream();
+
+    DatasetStream(const DatasetStream&) = delete;
+    DatasetStream& operator=(const DatasetStream&) = delete;
+
+    size_t Rows() const { return rows; }
+    size_t Cols() const { return block.Cols(); }
+    size_t BlockRows() const { return block.Rows(); }
+    const gsl::span<const Variable> Variables() const { return block.Variables(); }
+
+    const Dataset& Block() const { return block; }
+
+    // loads at most BlockRows() rows starting at the given row into the block and returns the number of rows loaded
+    size_t Load(size_t row);
+
+    // calls f(block, blockRange, offset) for the consecutive blocks of rows covering the range, where blockRange
+    // are the rows of the block within the range and offset is the position of the block's first row in the range
+    // (when evaluating many trees, evaluate all of them on each block to read the data only once)
+    template <typename F>
+    void ForEach(Range range, F&& f)
+    {
+        Expects(range.End() <= rows);
+        for (size_t start = range.Start(); start < range.End(); start += BlockRows()) {
+            auto n = std::min(Load(start), range.End() - start);
+            f(static_cast<const Dataset&>(block), Range { 0, n }, start - range.Start());
+        }
     }
+
+private:
+    int fd = -1;
+    size_t rows = 0;
+    size_t stride = 0;
+    size_t dataOffset = 0;
+    Dataset block;
 };
 }
 
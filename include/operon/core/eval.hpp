@@ -22,8 +22,17 @@
 
 #include "dataset.hpp"
 #include "gsl/gsl"
+#include "jit.hpp"
+#include "math.hpp"
+#include "nodevalues.hpp"
+#include "plan.hpp"
+#include "stat/meanvariance.hpp"
+#include "stat/pearson.hpp"
+#include "subtreecache.hpp"
 #include "tree.hpp"
 #include <ceres/ceres.h>
+#include <array>
+#include <chrono>
 #include <execution>
 
 #include <Eigen/Core>
@@ -31,8 +40,89 @@
 #include <Eigen/Eigen>
 
 namespace Operon {
+// default number of rows processed per interpreter step
 constexpr gsl::index BATCHSIZE = 64;
 
+// batch sizes supported by the runtime dispatch of Evaluate
+constexpr std::array<gsl::index, 5> BatchSizes { 16, 32, 64, 128, 256 };
+
+// batch size used for a given scalar type and tree length; trees are grouped into length buckets by powers of two
+// (the last bucket holds all trees longer than 2^(Buckets-1)). the table defaults to BATCHSIZE and can be tuned for
+// the current machine with CalibrateBatchSize. the table is not synchronized: update it before evaluation starts
+template <typename T>
+class BatchSizeTable {
+public:
+    static constexpr size_t Buckets = 9;
+
+    static size_t Bucket(size_t length) noexcept
+    {
+        size_t bucket = 0;
+        while (length > 1 && bucket < Buckets - 1) {
+            length >>= 1;
+            ++bucket;
+        }
+        return bucket;
+    }
+
+    static gsl::index Get(size_t length) noexcept { return Table()[Bucket(length)]; }
+    static void Set(size_t bucket, gsl::index batchSize) { Table()[bucket] = batchSize; }
+    static void Reset() { Table().fill(BATCHSIZE); }
+
+    static std::array<gsl::index, Buckets>& Table() noexcept
+    {
+        static std::array<gsl::index, Buckets> table = []() {
+            std::array<gsl::index, Buckets> t;
+            t.fill(BATCHSIZE);
+            return t;
+        }();
+        return table;
+    }
+};
+
+// thread-local storage reused across evaluations, such that evaluating in a steady state does not touch the heap
+// the buffers grow to the largest plan/range seen by the owning thread and are never released
+template <typename T>
+class EvaluationWorkspace {
+public:
+    template <gsl::index S>
+    using BufferType = Eigen::Map<Eigen::Array<T, S, Eigen::Dynamic, Eigen::ColMajor>, Eigen::AlignedMax>;
+
+    static EvaluationWorkspace& Local() noexcept
+    {
+        thread_local EvaluationWorkspace workspace;
+        return workspace;
+    }
+
+    // interpreter scratch buffer of S rows with at least the requested number of columns
+    template <gsl::index S>
+    BufferType<S> Buffer(size_t columns)
+    {
+        if (buffer.size() < S * columns) {
+            buffer.resize(S * columns);
+        }
+        return BufferType<S>(buffer.data(), S, columns);
+    }
+
+    // storage for the estimated values (eg. of the tree currently being evaluated for fitness)
+    gsl::span<T> Estimated(size_t size)
+    {
+        if (estimated.size() < size) {
+            estimated.resize(size);
+        }
+        return gsl::span<T>(estimated.data(), size);
+    }
+
+    // plan to be (re)compiled by the fitness evaluators
+    EvaluationPlan& Plan() noexcept { return plan; }
+
+private:
+    EvaluationWorkspace() = default;
+
+    Operon::Vector<T> buffer;
+    Operon::Vector<T> estimated;
+    EvaluationPlan plan;
+};
+
 template <typename T>
 inline std::pair<T, T> MinMax(gsl::span<T> values) noexcept
 {
@@ -63,141 +153,134 @@ inline void LimitToRange(gsl::span<T> values, T min, T max) noexcept
     }
 }
 
-template <typename T>
-Operon::Vector<T> Evaluate(const Tree& tree, const Dataset& dataset, const Range range, T const* const parameters = nullptr)
+// interpreter processing S rows at a time in the given scratch buffer (S rows, at least plan.BufferSize() columns)
+// the rows are those of the range or, if an index set is given, the rows at the range's positions in the index set
+// (in which case the variable values are gathered batch by batch into the buffer)
+template <gsl::index S, typename T>
+void Evaluate(const EvaluationPlan& plan, const Range range, T const* const parameters, gsl::span<T> result, gsl::span<const gsl::index> indices, typename EvaluationWorkspace<T>::template BufferType<S> m) noexcept
 {
-    Operon::Vector<T> result(range.Size());
-    Evaluate(tree, dataset, range, parameters, gsl::span<T>(result));
-    return result;
-}
+    auto const& code = plan.Instructions();
+    Eigen::Map<Eigen::Array<T, Eigen::Dynamic, 1, Eigen::ColMajor>> res(result.data(), result.size(), 1);
 
-template <typename T>
-void Evaluate(const Tree& tree, const Dataset& dataset, const Range range, T const* const parameters, gsl::span<T> result) noexcept
-{
-    auto& nodes = tree.Nodes();
-    Eigen::Array<T, BATCHSIZE, Eigen::Dynamic, Eigen::ColMajor> m(BATCHSIZE, nodes.size());
-    Eigen::Map<Eigen::Array<T, Eigen::Dynamic, 1, Eigen::ColMajor>> res(result.data(), result.size(), 1); 
-
-    auto indices = std::vector<gsl::index>(nodes.size());
-    gsl::index idx = 0;
-    for (size_t i = 0; i < nodes.size(); ++i) {
-        if (nodes[i].IsConstant()) {
-            auto v = parameters == nullptr ? T(nodes[i].Value) : parameters[idx];
-            m.col(i).setConstant(v);
-            idx++;
-        } else if (nodes[i].IsVariable()) {
-            indices[i] = dataset.GetIndex(nodes[i].HashValue);
-            idx++;
+    // with a linear layout the constant columns are never overwritten and only need to be filled once per call
+    bool linear = plan.Layout() == BufferLayout::Linear;
+    if (linear) {
+        for (auto const& s : code) {
+            if (s.Type == NodeType::Constant) {
+                m.col(s.Column).setConstant(parameters == nullptr ? T(s.Value) : parameters[s.Coefficient]);
+            }
         }
     }
 
-    auto lastCol = m.col(nodes.size()-1);
+    auto lastCol = m.col(code.back().Column);
 
     gsl::index numRows = range.Size();
-    for (gsl::index row = 0; row < numRows; row += BATCHSIZE) {
-        idx = 0;
-        auto remainingRows = std::min(BATCHSIZE, numRows - row);
-        for (size_t i = 0; i < nodes.size(); ++i) {
-            auto r = m.col(i);
+    for (gsl::index row = 0; row < numRows; row += S) {
+        auto remainingRows = std::min(S, numRows - row);
+        for (auto const& s : code) {
+            auto r = m.col(s.Column);
+            auto const* c = plan.Operands(s); // child columns
 
-            switch (auto const& s = nodes[i]; s.Type) {
+            switch (s.Type) {
             case NodeType::Add: {
-                //r = m.col(c);
-                //for (gsl::index k = 1, j = c - 1 - nodes[c].Length; k < s.Arity; ++k, j -= 1 + nodes[j].Length) {
-                //    r += m.col(j);
-                //}
-                auto c1 = i - 1; // first child index
-                auto c2 = c1 - 1 - nodes[c1].Length;
-                r = m.col(c1) + m.col(c2);
+                // n-ary: the result takes the place of the last child (see EvaluationPlan) which is thus read first
+                r = m.col(c[s.Arity - 1]) + m.col(c[s.Arity - 2]);
+                for (gsl::index k = s.Arity - 3; k >= 0; --k) {
+                    r += m.col(c[k]);
+                }
                 break;
             }
             case NodeType::Mul: {
-                //auto c = i - 1; // first child index
-                //r = m.col(c);
-                //for (gsl::index k = 1, j = c - 1 - nodes[c].Length; k < s.Arity; ++k, j -= 1 + nodes[j].Length) {
-                //    r *= m.col(j);
-                //}
-                auto c1 = i - 1; // first child index
-                auto c2 = c1 - 1 - nodes[c1].Length;
-                r = m.col(c1) * m.col(c2);
+                r = m.col(c[s.Arity - 1]) * m.col(c[s.Arity - 2]);
+                for (gsl::index k = s.Arity - 3; k >= 0; --k) {
+                    r *= m.col(c[k]);
+                }
                 break;
             }
             case NodeType::Sub: {
-                //auto c = i - 1; // first child index
-                //if (s.Arity == 1) {
-                //    r = -m.col(c);
-                //} else {
-                //    r = m.col(c);
-                //    for (gsl::index k = 1, j = c - 1 - nodes[c].Length; k < s.Arity; ++k, j -= 1 + nodes[j].Length) {
-                //        r -= m.col(j);
-                //    }
-                //}
-                auto c1 = i - 1; // first child index
-                auto c2 = c1 - 1 - nodes[c1].Length;
-                r = m.col(c1) - m.col(c2);
+                r = m.col(c[0]) - m.col(c[1]);
                 break;
             }
             case NodeType::Div: {
-                //auto c = i - 1; // first child index
-                //if (s.Arity == 1) {
-                //    r = m.col(c).inverse();
-                //} else {
-                //    r = m.col(c);
-                //    for (gsl::index k = 1, j = c - 1 - nodes[c].Length; k < s.Arity; ++k, j -= 1 + nodes[j].Length) {
-                //        r /= m.col(j);
-                //    }
-                //}
-                auto c1 = i - 1; // first child index
-                auto c2 = c1 - 1 - nodes[c1].Length;
-                r = m.col(c1) / m.col(c2);
+                r = m.col(c[0]) / m.col(c[1]);
                 break;
             }
             case NodeType::Log: {
-                r = m.col(i - 1).log();
+                r = m.col(c[0]).log();
                 break;
             }
             case NodeType::Exp: {
-                r = m.col(i - 1).exp();
+                r = m.col(c[0]).exp();
                 break;
             }
             case NodeType::Sin: {
-                r = m.col(i - 1).sin();
+                r = m.col(c[0]).unaryExpr(Math::Sin<T>());
                 break;
             }
             case NodeType::Cos: {
-                r = m.col(i - 1).cos();
+                r = m.col(c[0]).unaryExpr(Math::Cos<T>());
                 break;
             }
             case NodeType::Tan: {
-                r = m.col(i - 1).tan();
+                r = m.col(c[0]).unaryExpr(Math::Tan<T>());
                 break;
             }
             case NodeType::Sqrt: {
-                r = m.col(i - 1).sqrt();
+                r = m.col(c[0]).sqrt();
                 break;
             }
             case NodeType::Cbrt: {
-                r = m.col(i - 1).unaryExpr([](T v) { return T(ceres::cbrt(v)); });
+                r = m.col(c[0]).unaryExpr(Math::Cbrt<T>());
                 break;
             }
             case NodeType::Square: {
-                r = m.col(i - 1).square();
+                r = m.col(c[0]).square();
                 break;
             }
             case NodeType::Constant: {
-                idx++;
+                if (!linear) {
+                    r.setConstant(parameters == nullptr ? T(s.Value) : parameters[s.Coefficient]);
+                }
                 break;
             }
             case NodeType::Variable: {
-                auto w = parameters == nullptr ? T(s.Value) : parameters[idx++];
-                r.segment(0, remainingRows) = w * dataset.Values().col(indices[i]).segment(range.Start() + row, remainingRows).cast<T>();
+                auto w = parameters == nullptr ? T(s.Value) : parameters[s.Coefficient];
+                if (!indices.empty()) {
+                    auto const* idx = indices.data() + range.Start() + row;
+                    if constexpr (std::is_same_v<T, float>) {
+                        if (s.SingleData != nullptr) {
+                            for (gsl::index i = 0; i < remainingRows; ++i) {
+                                r(i) = w * s.SingleData[idx[i]];
+                            }
+                            break;
+                        }
+                    }
+                    for (gsl::index i = 0; i < remainingRows; ++i) {
+                        r(i) = w * T(s.Data[idx[i]]);
+                    }
+                    break;
+                }
+                if constexpr (std::is_same_v<T, float>) {
+                    if (s.SingleData != nullptr) {
+                        Eigen::Map<const Eigen::Array<float, Eigen::Dynamic, 1, Eigen::ColMajor>> x(s.SingleData + range.Start() + row, remainingRows);
+                        r.segment(0, remainingRows) = w * x;
+                        break;
+                    }
+                }
+                Eigen::Map<const Eigen::Array<Operon::Scalar, Eigen::Dynamic, 1, Eigen::ColMajor>> x(s.Data + range.Start() + row, remainingRows);
+                r.segment(0, remainingRows) = w * x.cast<T>();
                 break;
             }
             default: {
-                fmt::print(stderr, "Unknown node type {}\n", nodes[i].Name());
+                fmt::print(stderr, "Unknown node type {}\n", Node(s.Type).Name());
                 std::terminate();
             }
             }
+            if constexpr (std::is_same_v<T, Operon::Scalar>) {
+                if (s.Output != nullptr) {
+                    std::copy_n(r.data(), remainingRows, s.Output + range.Start() + row);
+                }
+            }
         }
         // the final result is found in the last section of the buffer corresponding to the root node
         res.segment(row, remainingRows) = lastCol.segment(0, remainingRows);
@@ -207,10 +290,251 @@ void Evaluate(const Tree& tree, const Dataset& dataset, const Range range, T con
     LimitToRange(result, min, max);
 }
 
+// interpreter processing S rows at a time in the scratch buffer of the thread's workspace
+template <gsl::index S, typename T>
+void Evaluate(const EvaluationPlan& plan, const Range range, T const* const parameters, gsl::span<T> result, gsl::span<const gsl::index> indices = {}) noexcept
+{
+    Evaluate<S>(plan, range, parameters, result, indices, EvaluationWorkspace<T>::Local().template Buffer<S>(plan.BufferSize()));
+}
+
+// dispatches to the interpreter using the batch size configured for the plan length
+template <typename T>
+void Evaluate(const EvaluationPlan& plan, const Range range, T const* const parameters, gsl::span<T> result, gsl::span<const gsl::index> indices = {}) noexcept
+{
+    switch (BatchSizeTable<T>::Get(plan.Length())) {
+    case 16:
+        Evaluate<16>(plan, range, parameters, result, indices);
+        break;
+    case 32:
+        Evaluate<32>(plan, range, parameters, result, indices);
+        break;
+    case 128:
+        Evaluate<128>(plan, range, parameters, result, indices);
+        break;
+    case 256:
+        Evaluate<256>(plan, range, parameters, result, indices);
+        break;
+    default:
+        Evaluate<BATCHSIZE>(plan, range, parameters, result, indices);
+        break;
+    }
+}
+
+template <typename T>
+Operon::Vector<T> Evaluate(const EvaluationPlan& plan, const Range range, T const* const parameters = nullptr)
+{
+    Operon::Vector<T> result(range.Size());
+    Evaluate(plan, range, parameters, gsl::span<T>(result));
+    return result;
+}
+
+// evaluates the rows of an index set (eg. a cross-validation fold or a bootstrap sample) in place, without
+// materializing them into a separate dataset
+template <typename T>
+void Evaluate(const EvaluationPlan& plan, gsl::span<const gsl::index> rows, T const* const parameters, gsl::span<T> result) noexcept
+{
+    Evaluate(plan, Range { 0, rows.size() }, parameters, result, rows);
+}
+
+template <typename T>
+Operon::Vector<T> Evaluate(const EvaluationPlan& plan, gsl::span<const gsl::index> rows, T const* const parameters = nullptr)
+{
+    Operon::Vector<T> result(rows.size());
+    Evaluate(plan, rows, parameters, gsl::span<T>(result));
+    return result;
+}
+
+// evaluates the plan (with its own coefficients) over the range, reading the subtrees found in the cache instead of
+// evaluating them and adding the other cacheable subtrees to the cache as a by-product of the evaluation
+inline void Evaluate(const EvaluationPlan& plan, const Range range, gsl::span<Operon::Scalar> result, SubtreeCache& cache)
+{
+    struct State {
+        std::vector<Operon::Hash> hashes;
+        std::vector<std::pair<gsl::index, Operon::Scalar const*>> loads;
+        std::vector<std::pair<gsl::index, Operon::Scalar*>> stores;
+        std::vector<std::shared_ptr<const SubtreeCache::ValueType>> hits; // keeps the loaded values alive
+        std::vector<std::pair<gsl::index, std::shared_ptr<SubtreeCache::ValueType>>> misses;
+        EvaluationPlan plan;
+    };
+    thread_local State state;
+
+    auto const& code = plan.Instructions();
+    plan.SubtreeHashes(state.hashes);
+    state.loads.clear();
+    state.stores.clear();
+
+    // top-down, so that the descendants of a cached subtree are not looked up
+    for (gsl::index i = code.size() - 1; i >= 0; --i) {
+        auto const& s = code[i];
+        if (s.Arity == 0 || s.Length < cache.MinLength()) {
+            continue;
+        }
+        if (auto values = cache.Find(state.hashes[i], range); values != nullptr) {
+            state.loads.emplace_back(i, values->data());
+            state.hits.push_back(std::move(values));
+            i -= s.Length;
+        } else if (cache.Admit(state.hashes[i], range)) {
+            auto column = std::make_shared<SubtreeCache::ValueType>(range.Size());
+            state.stores.emplace_back(i, column->data());
+            state.misses.emplace_back(i, std::move(column));
+        }
+    }
+
+    if (state.loads.empty() && state.stores.empty()) {
+        Evaluate<Operon::Scalar>(plan, range, nullptr, result);
+        return;
+    }
+    std::reverse(state.loads.begin(), state.loads.end());
+    std::reverse(state.stores.begin(), state.stores.end());
+    state.plan.Derive(plan, range, state.loads, state.stores);
+    Evaluate<Operon::Scalar>(state.plan, Range { 0, range.Size() }, nullptr, result);
+
+    for (auto& [i, column] : state.misses) {
+        cache.Insert(state.hashes[i], range, std::move(column));
+    }
+    state.hits.clear();
+    state.misses.clear();
+}
+
+// evaluates the tree compiled into the plan (against the dataset of the parent values) over the range of the parent
+// values, reading the values of the subtrees it shares with the parent at the same position instead of evaluating
+// them (see NodeValues::SharedSubtrees)
+// returns the number of nodes which did not have to be evaluated
+inline size_t EvaluateIncremental(const EvaluationPlan& plan, const Tree& tree, const NodeValues& parent, gsl::span<Operon::Scalar> result)
+{
+    thread_local std::vector<std::pair<gsl::index, Operon::Scalar const*>> loads;
+    thread_local EvaluationPlan derived;
+
+    loads.clear();
+    auto reused = parent.SharedSubtrees(tree, &loads);
+
+    auto range = parent.GetRange();
+    if (loads.empty()) {
+        Evaluate<Operon::Scalar>(plan, range, nullptr, result);
+        return 0;
+    }
+    std::reverse(loads.begin(), loads.end());
+    derived.Derive(plan, range, loads, {});
+    Evaluate<Operon::Scalar>(derived, Range { 0, range.Size() }, nullptr, result);
+    return reused;
+}
+
+// convenience overloads compiling a one-off plan for the tree (into thread-local storage)
+template <typename T>
+void Evaluate(const Tree& tree, const Dataset& dataset, const Range range, T const* const parameters, gsl::span<T> result) noexcept
+{
+    thread_local EvaluationPlan plan;
+    plan.Compile(tree, dataset);
+    Evaluate(plan, range, parameters, result);
+}
+
+template <typename T>
+Operon::Vector<T> Evaluate(const Tree& tree, const Dataset& dataset, const Range range, T const* const parameters = nullptr)
+{
+    Operon::Vector<T> result(range.Size());
+    Evaluate(tree, dataset, range, parameters, gsl::span<T>(result));
+    return result;
+}
+
+// evaluates the tree over the given rows of a dataset stream one block at a time, calling f(estimated, block, blockRange)
+// with the estimated values for the blockRange rows of the block (nan and inf values are replaced per block)
+template <typename T, typename F>
+void Evaluate(const Tree& tree, DatasetStream& stream, const Range range, F&& f)
+{
+    // the block storage does not move when the next block is loaded, so the plan is compiled only once
+    EvaluationPlan plan(tree, stream.Block());
+    Operon::Vector<T> estimated(stream.BlockRows());
+    stream.ForEach(range, [&](const Dataset& block, Range blockRange, size_t) {
+        auto values = gsl::span<T>(estimated).subspan(0, blockRange.Size());
+        Evaluate<T>(plan, blockRange, static_cast<T const*>(nullptr), values);
+        f(gsl::span<const T>(values), block, blockRange);
+    });
+}
+
+// streamed counterparts of RSquared and NormalizedMeanSquaredError (see metrics.hpp), accumulated block by block
+// they equal the in-memory metrics of the same rows, except for trees with non-finite values: these are replaced with
+// the midpoint of the finite values of their block rather than of the whole range (which would take a second pass)
+template <typename T = Operon::Scalar>
+Operon::Scalar RSquared(const Tree& tree, DatasetStream& stream, const Range range, const std::string& target)
+{
+    auto hash = stream.Block().GetHashValue(target);
+    PearsonsRCalculator calc;
+    Evaluate<T>(tree, stream, range, [&](auto estimated, auto const& block, auto blockRange) {
+        auto targetValues = block.GetValues(hash).subspan(blockRange.Start(), blockRange.Size());
+        for (size_t i = 0; i < estimated.size(); ++i) {
+            calc.Add(estimated[i], targetValues[i]);
+        }
+    });
+    auto r = calc.Correlation();
+    return r * r;
+}
+
+template <typename T = Operon::Scalar>
+Operon::Scalar NormalizedMeanSquaredError(const Tree& tree, DatasetStream& stream, const Range range, const std::string& target)
+{
+    auto hash = stream.Block().GetHashValue(target);
+    MeanVarianceCalculator ycalc;
+    MeanVarianceCalculator errcalc;
+    Evaluate<T>(tree, stream, range, [&](auto estimated, auto const& block, auto blockRange) {
+        auto targetValues = block.GetValues(hash).subspan(blockRange.Start(), blockRange.Size());
+        for (size_t i = 0; i < estimated.size(); ++i) {
+            if (!std::isfinite(targetValues[i])) {
+                continue;
+            }
+            ycalc.Add(targetValues[i]);
+            auto e = estimated[i] - targetValues[i];
+            errcalc.Add(e * e);
+        }
+    });
+    auto yvar = ycalc.NaiveVariance();
+    return yvar > 0 ? errcalc.Mean() / yvar : yvar;
+}
+
+// measures the evaluation time of the given trees for each supported batch size and stores the fastest batch size
+// for each length bucket in BatchSizeTable<T> (buckets without trees are left unchanged). returns the updated table
+template <typename T>
+std::array<gsl::index, BatchSizeTable<T>::Buckets> CalibrateBatchSize(gsl::span<const Tree> trees, const Dataset& dataset, const Range range, size_t repetitions = 3)
+{
+    std::array<std::vector<EvaluationPlan>, BatchSizeTable<T>::Buckets> plans;
+    for (const auto& tree : trees) {
+        plans[BatchSizeTable<T>::Bucket(tree.Length())].emplace_back(tree, dataset);
+    }
+    Operon::Vector<T> result(range.Size());
+
+    auto measure = [&](auto batchSize, const auto& bucket) {
+        constexpr gsl::index S = decltype(batchSize)::value;
+        auto best = std::chrono::steady_clock::duration::max();
+        for (size_t i = 0; i < repetitions; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            for (const auto& plan : bucket) {
+                Evaluate<S>(plan, range, static_cast<T const*>(nullptr), gsl::span<T>(result));
+            }
+            best = std::min(best, std::chrono::steady_clock::now() - start);
+        }
+        return best;
+    };
+
+    for (size_t b = 0; b < plans.size(); ++b) {
+        const auto& bucket = plans[b];
+        if (bucket.empty()) {
+            continue;
+        }
+        std::array<std::chrono::steady_clock::duration, BatchSizes.size()> elapsed {
+            measure(std::integral_constant<gsl::index, BatchSizes[0]> {}, bucket),
+            measure(std::integral_constant<gsl::index, BatchSizes[1]> {}, bucket),
+            measure(std::integral_constant<gsl::index, BatchSizes[2]> {}, bucket),
+            measure(std::integral_constant<gsl::index, BatchSizes[3]> {}, bucket),
+            measure(std::integral_constant<gsl::index, BatchSizes[4]> {}, bucket),
+        };
+        auto fastest = std::min_element(elapsed.begin(), elapsed.end()) - elapsed.begin();
+        BatchSizeTable<T>::Set(b, BatchSizes[fastest]);
+    }
+    return BatchSizeTable<T>::Table();
+}
+
 struct ParameterizedEvaluation {
-    ParameterizedEvaluation(const Tree& tree, const Dataset& dataset, const gsl::span<const Operon::Scalar> targetValues, const Range range)
-        : tree_ref(tree)
-        , dataset_ref(dataset)
+    ParameterizedEvaluation(const EvaluationPlan& plan, const gsl::span<const Operon::Scalar> targetValues, const Range range)
+        : plan_ref(plan)
         , target_ref(targetValues)
         , range(range)
     {
@@ -220,7 +544,7 @@ struct ParameterizedEvaluation {
     bool operator()(T const* const* parameters, T* residuals) const
     {
         auto res = gsl::span<T>(residuals, range.Size());
-        Evaluate(tree_ref, dataset_ref, range, parameters[0], res);
+        Evaluate(plan_ref.get(), range, parameters[0], res);
         Eigen::Map<Eigen::Array<T, Eigen::Dynamic, 1, Eigen::ColMajor>> resMap(residuals, range.Size());
         Eigen::Map<const Eigen::Array<Operon::Scalar, Eigen::Dynamic, 1, Eigen::ColMajor>> targetMap(target_ref.data(), range.Size());
         resMap -= targetMap;
@@ -228,37 +552,395 @@ struct ParameterizedEvaluation {
     }
 
 private:
-    std::reference_wrapper<const Tree> tree_ref;
-    std::reference_wrapper<const Dataset> dataset_ref;
+    std::reference_wrapper<const EvaluationPlan> plan_ref;
     gsl::span<const Operon::Scalar> target_ref;
     Range range;
 };
 
+// computes the residuals and their Jacobian with respect to the plan coefficients in a single batched pass:
+// a forward sweep stores the values of all the nodes, then a reverse sweep propagates the adjoints from the root
+// to the leaves (each node has exactly one parent, so every adjoint is obtained with a single assignment). the cost
+// of the Jacobian is thus a small constant multiple of the cost of evaluation, independent of the number of
+// coefficients, as opposed to forward-mode (Jet-based) differentiation whose cost grows with it.
+// non-finite residuals are replaced like in Evaluate and their Jacobian rows are set to zero
+class ReverseModeCostFunction : public ceres::CostFunction {
+public:
+    // column-major view of a Jacobian block (rows x coefficients) with arbitrary strides
+    using JacobianMap = Eigen::Map<Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>, Eigen::Unaligned, Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>>;
+
+    ReverseModeCostFunction() = default;
+
+    ReverseModeCostFunction(const EvaluationPlan& plan, const gsl::span<const Operon::Scalar> targetValues, const Range range)
+    {
+        Reset(plan, targetValues, range);
+    }
+
+    // residuals over the rows of an index set, with the target values given in the same order
+    ReverseModeCostFunction(const EvaluationPlan& plan, const gsl::span<const Operon::Scalar> targetValues, gsl::span<const gsl::index> rows)
+    {
+        Reset(plan, targetValues, rows);
+    }
+
+    void Reset(const EvaluationPlan& plan, const gsl::span<const Operon::Scalar> targetValues, gsl::span<const gsl::index> rows)
+    {
+        Reset(plan, targetValues, Range { 0, rows.size() });
+        indices = rows;
+    }
+
+    // binds the cost function to another problem, reusing the already allocated storage
+    void Reset(const EvaluationPlan& plan, const gsl::span<const Operon::Scalar> targetValues, const Range range)
+    {
+        plan_ptr = &plan;
+        target_ref = targetValues;
+        this->range = range;
+        indices = {};
+
+        set_num_residuals(range.Size());
+        mutable_parameter_block_sizes()->clear();
+        mutable_parameter_block_sizes()->push_back(plan.CoefficientsCount());
+
+        auto const& code = plan.Instructions();
+        if (values.size() < BATCHSIZE * code.size()) {
+            values.resize(BATCHSIZE * code.size());
+            adjoints.resize(BATCHSIZE * code.size());
+        }
+        column.resize(BATCHSIZE);
+
+        // the children of each instruction as instruction indices (the plan itself refers to buffer columns,
+        // which depend on its layout); in postfix order they are the topmost entries of the evaluation stack
+        children.clear();
+        stack.clear();
+        for (size_t i = 0; i < code.size(); ++i) {
+            auto arity = code[i].Arity;
+            for (size_t k = 0; k < arity; ++k) {
+                children.push_back(stack[stack.size() - 1 - k]);
+            }
+            stack.resize(stack.size() - arity);
+            stack.push_back(i);
+        }
+    }
+
+    bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const override
+    {
+        auto const& plan = *plan_ptr;
+        auto const* coefficients = parameters[0];
+        gsl::index numRows = range.Size();
+        Eigen::Map<Eigen::Array<double, Eigen::Dynamic, 1, Eigen::ColMajor>> res(residuals, numRows);
+
+        if (jacobians == nullptr || jacobians[0] == nullptr) {
+            Eigen::Map<const Eigen::Array<Operon::Scalar, Eigen::Dynamic, 1, Eigen::ColMajor>> target(target_ref.data(), numRows);
+            if (native != nullptr && native->Plan() == plan_ptr && indices.empty()) {
+                native->Evaluate(range, coefficients, gsl::span<double>(residuals, numRows));
+            } else {
+                Operon::Evaluate(plan, range, coefficients, gsl::span<double>(residuals, numRows), indices);
+            }
+            res -= target.cast<double>();
+            return true;
+        }
+
+        auto numParameters = static_cast<gsl::index>(plan.CoefficientsCount());
+        for (gsl::index row = 0; row < numRows; row += BATCHSIZE) {
+            auto remainingRows = std::min(BATCHSIZE, numRows - row);
+            // ceres expects a row-major Jacobian
+            JacobianMap jac(jacobians[0] + row * numParameters, remainingRows, numParameters, Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>(1, numParameters));
+            EvaluateBatch(coefficients, row, remainingRows, residuals + row, &jac);
+        }
+
+        // replace nan and inf values (a finite value can still have non-finite partials, eg. sqrt at zero)
+        Eigen::Map<Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> jac(jacobians[0], numRows, numParameters);
+        for (gsl::index row = 0; row < numRows; ++row) {
+            if (!std::isfinite(res(row)) || !jac.row(row).allFinite()) {
+                jac.row(row).setZero();
+            }
+        }
+        auto [min, max] = MinMax(gsl::span<double>(residuals, numRows));
+        LimitToRange(gsl::span<double>(residuals, numRows), min, max);
+        Eigen::Map<const Eigen::Array<Operon::Scalar, Eigen::Dynamic, 1, Eigen::ColMajor>> target(target_ref.data(), numRows);
+        res -= target.cast<double>();
+        return true;
+    }
+
+    // batch-level interface: evaluates the model for `rows` (at most BATCHSIZE) rows starting at offset `row` of the
+    // range, writing the raw model values (no target subtraction, no replacement of non-finite values) and, if the
+    // Jacobian is not null, the derivatives of the values with respect to the coefficients
+    void EvaluateBatch(double const* coefficients, gsl::index row, gsl::index rows, double* output, JacobianMap* jacobian) const
+    {
+        auto const& code = plan_ptr->Instructions();
+        Forward(code, coefficients, range.Start() + row, rows);
+        BufferMap v(values.data(), BATCHSIZE, code.size());
+        Eigen::Map<Eigen::Array<double, Eigen::Dynamic, 1>>(output, rows) = v.col(code.size() - 1).head(rows);
+
+        if (jacobian == nullptr) {
+            return;
+        }
+        Reverse(code);
+        BufferMap a(adjoints.data(), BATCHSIZE, code.size());
+        for (size_t i = 0; i < code.size(); ++i) {
+            auto const& s = code[i];
+            if (s.Type == NodeType::Constant) {
+                jacobian->col(s.Coefficient) = a.col(i).head(rows);
+            } else if (s.Type == NodeType::Variable) {
+                jacobian->col(s.Coefficient) = a.col(i).head(rows) * Variable(s, range.Start() + row, rows);
+            }
+        }
+    }
+
+    // optional native code of the plan (see NativePlan), used instead of the interpreter for the evaluations without
+    // Jacobian (eg. the trial steps of ceres) over a range; it is ignored if it was generated for another plan
+    void Native(const NativePlan* value) noexcept { native = value; }
+
+    const EvaluationPlan& Plan() const noexcept { return *plan_ptr; }
+    const gsl::span<const Operon::Scalar> TargetValues() const noexcept { return target_ref; }
+    const Range& GetRange() const noexcept { return range; }
+    const gsl::span<const gsl::index> Indices() const noexcept { return indices; }
+
+private:
+    using BufferMap = Eigen::Map<Eigen::Array<double, BATCHSIZE, Eigen::Dynamic, Eigen::ColMajor>, Eigen::AlignedMax>;
+
+    // values of a variable (without its weight) for `rows` rows starting at position `start`, gathered through the
+    // index set if there is one
+    Eigen::Map<const Eigen::Array<double, Eigen::Dynamic, 1, Eigen::ColMajor>> Variable(const Instruction& s, gsl::index start, gsl::index rows) const
+    {
+        if (indices.empty()) {
+            return { s.Data + start, rows };
+        }
+        for (gsl::index i = 0; i < rows; ++i) {
+            column[i] = s.Data[indices[start + i]];
+        }
+        return { column.data(), rows };
+    }
+
+    void Forward(const std::vector<Instruction>& code, double const* coefficients, gsl::index start, gsl::index remainingRows) const
+    {
+        BufferMap values(this->values.data(), BATCHSIZE, code.size());
+        for (size_t i = 0; i < code.size(); ++i) {
+            auto const& s = code[i];
+            auto r = values.col(i);
+            auto const* c = children.data() + s.Operands;
+
+            switch (s.Type) {
+            case NodeType::Add: {
+                // n-ary, summed in the same order as the interpreter
+                r = values.col(c[s.Arity - 1]) + values.col(c[s.Arity - 2]);
+                for (gsl::index k = s.Arity - 3; k >= 0; --k) {
+                    r += values.col(c[k]);
+                }
+                break;
+            }
+            case NodeType::Mul: {
+                r = values.col(c[s.Arity - 1]) * values.col(c[s.Arity - 2]);
+                for (gsl::index k = s.Arity - 3; k >= 0; --k) {
+                    r *= values.col(c[k]);
+                }
+                break;
+            }
+            case NodeType::Sub: {
+                r = values.col(c[0]) - values.col(c[1]);
+                break;
+            }
+            case NodeType::Div: {
+                r = values.col(c[0]) / values.col(c[1]);
+                break;
+            }
+            case NodeType::Log: {
+                r = values.col(c[0]).log();
+                break;
+            }
+            case NodeType::Exp: {
+                r = values.col(c[0]).exp();
+                break;
+            }
+            case NodeType::Sin: {
+                r = values.col(c[0]).unaryExpr(Math::Sin<double>());
+                break;
+            }
+            case NodeType::Cos: {
+                r = values.col(c[0]).unaryExpr(Math::Cos<double>());
+                break;
+            }
+            case NodeType::Tan: {
+                r = values.col(c[0]).unaryExpr(Math::Tan<double>());
+                break;
+            }
+            case NodeType::Sqrt: {
+                r = values.col(c[0]).sqrt();
+                break;
+            }
+            case NodeType::Cbrt: {
+                r = values.col(c[0]).unaryExpr(Math::Cbrt<double>());
+                break;
+            }
+            case NodeType::Square: {
+                r = values.col(c[0]).square();
+                break;
+            }
+            case NodeType::Constant: {
+                r.setConstant(coefficients[s.Coefficient]);
+                break;
+            }
+            case NodeType::Variable: {
+                r.head(remainingRows) = coefficients[s.Coefficient] * Variable(s, start, remainingRows);
+                break;
+            }
+            default: {
+                fmt::print(stderr, "Unknown node type {}\n", Node(s.Type).Name());
+                std::terminate();
+            }
+            }
+        }
+    }
+
+    void Reverse(const std::vector<Instruction>& code) const
+    {
+        BufferMap values(this->values.data(), BATCHSIZE, code.size());
+        BufferMap adjoints(this->adjoints.data(), BATCHSIZE, code.size());
+        adjoints.col(code.size() - 1).setOnes();
+        for (gsl::index i = static_cast<gsl::index>(code.size()) - 1; i >= 0; --i) {
+            auto const& s = code[i];
+            auto a = adjoints.col(i);
+            auto v = values.col(i);
+            auto const* c = children.data() + s.Operands;
+
+            switch (s.Type) {
+            case NodeType::Add: {
+                for (gsl::index k = 0; k < s.Arity; ++k) {
+                    adjoints.col(c[k]) = a;
+                }
+                break;
+            }
+            case NodeType::Mul: {
+                // the adjoint of each child is a times the product of the other children: the products of the
+                // preceding children are accumulated forward, those of the following children backward
+                // (no division by the child's value, which may be zero)
+                adjoints.col(c[0]) = a;
+                for (gsl::index k = 1; k < s.Arity; ++k) {
+                    adjoints.col(c[k]) = adjoints.col(c[k - 1]) * values.col(c[k - 1]);
+                }
+                Eigen::Array<double, BATCHSIZE, 1> following = values.col(c[s.Arity - 1]);
+                for (gsl::index k = s.Arity - 2; k >= 0; --k) {
+                    adjoints.col(c[k]) *= following;
+                    following *= values.col(c[k]);
+                }
+                break;
+            }
+            case NodeType::Sub: {
+                adjoints.col(c[0]) = a;
+                adjoints.col(c[1]) = -a;
+                break;
+            }
+            case NodeType::Div: {
+                adjoints.col(c[0]) = a / values.col(c[1]);
+                adjoints.col(c[1]) = -a * v / values.col(c[1]);
+                break;
+            }
+            case NodeType::Log: {
+                adjoints.col(c[0]) = a / values.col(c[0]);
+                break;
+            }
+            case NodeType::Exp: {
+                adjoints.col(c[0]) = a * v;
+                break;
+            }
+            case NodeType::Sin: {
+                adjoints.col(c[0]) = a * values.col(c[0]).unaryExpr(Math::Cos<double>());
+                break;
+            }
+            case NodeType::Cos: {
+                adjoints.col(c[0]) = -a * values.col(c[0]).unaryExpr(Math::Sin<double>());
+                break;
+            }
+            case NodeType::Tan: {
+                adjoints.col(c[0]) = a * (1.0 + v.square());
+                break;
+            }
+            case NodeType::Sqrt: {
+                adjoints.col(c[0]) = a * 0.5 / v;
+                break;
+            }
+            case NodeType::Cbrt: {
+                adjoints.col(c[0]) = a / (3.0 * v.square());
+                break;
+            }
+            case NodeType::Square: {
+                adjoints.col(c[0]) = a * 2.0 * values.col(c[0]);
+                break;
+            }
+            default: {
+                break;
+            }
+            }
+        }
+    }
+
+    const EvaluationPlan* plan_ptr = nullptr;
+    const NativePlan* native = nullptr;
+    gsl::span<const Operon::Scalar> target_ref;
+    Range range;
+    gsl::span<const gsl::index> indices; // optional index set, the range then refers to positions within it
+    std::vector<gsl::index> children;
+    std::vector<gsl::index> stack;
+    mutable Operon::Vector<double> values;
+    mutable Operon::Vector<double> adjoints;
+    mutable Operon::Vector<double> column; // gathered variable values
+};
+
+namespace detail {
+    // solves the least squares problem defined by the cost function and optionally writes the coefficients back
+    inline ceres::Solver::Summary Optimize(Tree& tree, EvaluationPlan& plan, ceres::CostFunction* costFunction, std::vector<Operon::Scalar>& coef, size_t iterations, bool writeCoefficients, bool report)
+    {
+        using ceres::Problem;
+        using ceres::Solve;
+        using ceres::Solver;
+
+        if (report) {
+            fmt::print("x_0: ");
+            for (auto c : coef)
+                fmt::print("{} ", c);
+            fmt::print("\n");
+        }
+
+        //auto lossFunction = new CauchyLoss(0.5); // see http://ceres-solver.org/nnls_tutorial.html#robust-curve-fitting
+
+        Problem problem;
+        problem.AddResidualBlock(costFunction, nullptr, coef.data());
+
+        Solver::Options options;
+        options.max_num_iterations = iterations - 1; // workaround since for some reason ceres sometimes does 1 more iteration
+        options.linear_solver_type = ceres::DENSE_QR;
+        options.minimizer_progress_to_stdout = report;
+        options.num_threads = 1;
+        Solver::Summary summary;
+        Solve(options, &problem, &summary);
+
+        if (report) {
+            fmt::print("{}\n", summary.BriefReport());
+            fmt::print("x_final: ");
+            for (auto c : coef)
+                fmt::print("{} ", c);
+            fmt::print("\n");
+        }
+        if (writeCoefficients) {
+            tree.SetCoefficients(coef);
+            plan.SetCoefficients(coef);
+        }
+        return summary;
+    }
+} // namespace detail
+
 // returns an array of optimized parameters
 template <bool autodiff = true>
-ceres::Solver::Summary Optimize(Tree& tree, const Dataset& dataset, const gsl::span<const Operon::Scalar> targetValues, const Range range, size_t iterations = 50, bool writeCoefficients = true, bool report = false)
+ceres::Solver::Summary Optimize(Tree& tree, EvaluationPlan& plan, const gsl::span<const Operon::Scalar> targetValues, const Range range, size_t iterations = 50, bool writeCoefficients = true, bool report = false)
 {
-    using ceres::CauchyLoss;
     using ceres::DynamicAutoDiffCostFunction;
     using ceres::DynamicCostFunction;
     using ceres::DynamicNumericDiffCostFunction;
-    using ceres::Problem;
-    using ceres::Solve;
-    using ceres::Solver;
 
-    Solver::Summary summary;
-    auto coef = tree.GetCoefficients();
+    auto coef = plan.GetCoefficients();
     if (coef.empty()) {
-        return summary;
-    }
-    if (report) {
-        fmt::print("x_0: ");
-        for (auto c : coef)
-            fmt::print("{} ", c);
-        fmt::print("\n");
+        return ceres::Solver::Summary {};
     }
 
-    auto eval = new ParameterizedEvaluation(tree, dataset, targetValues, range);
+    auto eval = new ParameterizedEvaluation(plan, targetValues, range);
     DynamicCostFunction* costFunction;
     if constexpr (autodiff) {
         costFunction = new DynamicAutoDiffCostFunction<ParameterizedEvaluation>(eval);
@@ -267,29 +949,43 @@ ceres::Solver::Summary Optimize(Tree& tree, const Dataset& dataset, const gsl::s
     }
     costFunction->AddParameterBlock(coef.size());
     costFunction->SetNumResiduals(range.Size());
-    //auto lossFunction = new CauchyLoss(0.5); // see http://ceres-solver.org/nnls_tutorial.html#robust-curve-fitting
-
-    Problem problem;
-    problem.AddResidualBlock(costFunction, nullptr, coef.data());
-
-    Solver::Options options;
-    options.max_num_iterations = iterations - 1; // workaround since for some reason ceres sometimes does 1 more iteration
-    options.linear_solver_type = ceres::DENSE_QR;
-    options.minimizer_progress_to_stdout = report;
-    options.num_threads = 1;
-    Solve(options, &problem, &summary);
+    return detail::Optimize(tree, plan, costFunction, coef, iterations, writeCoefficients, report);
+}
 
-    if (report) {
-        fmt::print("{}\n", summary.BriefReport());
-        fmt::print("x_final: ");
-        for (auto c : coef)
-            fmt::print("{} ", c);
-        fmt::print("\n");
+// local optimization using the Jacobian computed by reverse-mode differentiation
+// the residuals without Jacobian are evaluated with the native code of the plan if one is given
+inline ceres::Solver::Summary OptimizeReverse(Tree& tree, EvaluationPlan& plan, const gsl::span<const Operon::Scalar> targetValues, const Range range, size_t iterations = 50, bool writeCoefficients = true, bool report = false, const NativePlan* native = nullptr)
+{
+    auto coef = plan.GetCoefficients();
+    if (coef.empty()) {
+        return ceres::Solver::Summary {};
     }
-    if (writeCoefficients) {
-        tree.SetCoefficients(coef);
+    auto costFunction = new ReverseModeCostFunction(plan, targetValues, range);
+    costFunction->Native(native);
+    return detail::Optimize(tree, plan, costFunction, coef, iterations, writeCoefficients, report);
+}
+
+inline ceres::Solver::Summary OptimizeReverse(Tree& tree, EvaluationPlan& plan, const gsl::span<const Operon::Scalar> targetValues, gsl::span<const gsl::index> rows, size_t iterations = 50, bool writeCoefficients = true, bool report = false)
+{
+    auto coef = plan.GetCoefficients();
+    if (coef.empty()) {
+        return ceres::Solver::Summary {};
     }
-    return summary;
+    auto costFunction = new ReverseModeCostFunction(plan, targetValues, rows);
+    return detail::Optimize(tree, plan, costFunction, coef, iterations, writeCoefficients, report);
+}
+
+inline ceres::Solver::Summary OptimizeReverse(Tree& tree, const Dataset& dataset, const gsl::span<const Operon::Scalar> targetValues, const Range range, size_t iterations = 50, bool writeCoefficients = true, bool report = false)
+{
+    EvaluationPlan plan(tree, dataset);
+    return OptimizeReverse(tree, plan, targetValues, range, iterations, writeCoefficients, report);
+}
+
+template <bool autodiff = true>
+ceres::Solver::Summary Optimize(Tree& tree, const Dataset& dataset, const gsl::span<const Operon::Scalar> targetValues, const Range range, size_t iterations = 50, bool writeCoefficients = true, bool report = false)
+{
+    EvaluationPlan plan(tree, dataset);
+    return Optimize<autodiff>(tree, plan, targetValues, range, iterations, writeCoefficients, report);
 }
 
 // set up some convenience methods using perfect forwarding
@@ -0,0 +1,78 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+#ifndef FITNESS_CACHE_HPP
+#define FITNESS_CACHE_HPP
+
+#include <vector>
+
+#include "core/common.hpp"
+#include "core/shardedcache.hpp"
+
+namespace Operon {
+// bounded concurrent cache of the fitness of already evaluated trees, keyed by their strict hash (Tree::HashValue
+// after Tree::Sort with HashMode::Strict), such that offspring identical to an earlier individual are not evaluated
+// again. the coefficients found by local optimization are kept along with the fitness, so that a cache hit
+// produces the same individual as a new evaluation would
+// - the capacity is a number of entries, evicted in the given order (see ShardedLruCache)
+// - the cached fitness is only meaningful for the evaluator (and problem) which computed it, so a cache must not
+//   be shared between evaluators
+class FitnessCache {
+public:
+    using Eviction = CacheEviction;
+
+    struct Entry {
+        Operon::Scalar Fitness;
+        std::vector<Operon::Scalar> Coefficients;
+    };
+
+    struct Statistics {
+        size_t Lookups;
+        size_t Hits;
+        size_t Insertions;
+        size_t Evictions;
+        size_t Entries;
+
+        double HitRate() const noexcept { return Lookups == 0 ? 0.0 : static_cast<double>(Hits) / Lookups; }
+    };
+
+    static constexpr size_t DefaultCapacity = 1UL << 20; // entries
+
+    explicit FitnessCache(size_t capacity = DefaultCapacity, Eviction eviction = Eviction::LeastRecentlyUsed);
+
+    FitnessCache(const FitnessCache&) = delete;
+    FitnessCache& operator=(const FitnessCache&) = delete;
+
+    size_t Capacity() const noexcept { return cache.Capacity(); }
+    Eviction EvictionPolicy() const noexcept { return cache.EvictionPolicy(); }
+
+    // copies the cached entry into `entry` (reusing its storage) and returns true if the hash is found
+    bool Find(Operon::Hash hash, Entry& entry);
+    void Insert(Operon::Hash hash, const Entry& entry);
+
+    void Clear();
+
+    Statistics GetStatistics() const noexcept;
+    void ResetStatistics() noexcept;
+
+private:
+    ShardedLruCache<Operon::Hash, Entry> cache;
+};
+} // namespace Operon
+
+#endif
@@ -73,6 +73,15 @@ public:
     }
     size_t GetFrequency(NodeType type) const { return frequencies[NodeTypes::GetIndex(type)]; }
 
+    // additions and multiplications are associative and sampled with an arity drawn uniformly from [2, value]
+    // (the default of 2 only samples binary nodes)
+    void MaximumArity(size_t value)
+    {
+        Expects(value >= 2);
+        maximumArity = value;
+    }
+    size_t MaximumArity() const { return maximumArity; }
+
     static const GrammarConfig Arithmetic = NodeType::Constant | NodeType::Variable | NodeType::Add | NodeType::Sub | NodeType::Mul | NodeType::Div;
     static const GrammarConfig TypeCoherent = Arithmetic | NodeType::Exp | NodeType::Log | NodeType::Sin | NodeType::Cos | NodeType::Square;
     static const GrammarConfig Full = TypeCoherent | NodeType::Tan | NodeType::Sqrt | NodeType::Cbrt;
@@ -98,25 +107,28 @@ public:
             }
             size_t arity = i < 4 ? 2 : 1;
             minArity = std::min(minArity, arity);
-            maxArity = std::max(maxArity, arity);
+            maxArity = std::max(maxArity, i < 2 ? maximumArity : arity);
         }
         return { minArity, maxArity };
     }
 
+    // an arity above 2 selects an addition or a multiplication, with the requested arity even if it is above the
+    // maximum arity (eg. to replace the function of an existing node)
     Node SampleRandomSymbol(Operon::Random& random, size_t minArity = 0, size_t maxArity = 2) const
     {
         decltype(frequencies)::const_iterator head = frequencies.end();
         decltype(frequencies)::const_iterator tail = frequencies.end();
 
-        Expects(maxArity <= 2);
         Expects(minArity <= maxArity);
 
         if (minArity == 0) {
             tail = frequencies.end();
         } else if (minArity == 1) {
             tail = frequencies.end() - 2;
-        } else {
+        } else if (minArity == 2) {
             tail = frequencies.begin() + 4;
+        } else {
+            tail = frequencies.begin() + 2;
         }
 
         if (maxArity == 0) {
@@ -128,7 +140,7 @@ public:
         }
 
         if (std::all_of(head, tail, [](size_t v) { return v == 0; })) {
-            if (minArity == 0 && maxArity == 2) {
+            if (minArity == 0 && maxArity >= 2) {
                 throw new std::runtime_error(fmt::format("Could not sample any symbol as all frequencies are set to zero"));
             }
             return SampleRandomSymbol(random, minArity - 1, maxArity);
@@ -138,12 +150,23 @@ public:
         auto node = Node(static_cast<NodeType>(1u << i));
         Ensures(IsEnabled(node.Type));
 
+        if (node.Is<NodeType::Add, NodeType::Mul>()) {
+            auto lo = std::max(minArity, size_t { 2 });
+            auto hi = std::max(lo, std::min(maxArity, maximumArity));
+            if (hi > lo) {
+                node.Arity = node.Length = std::uniform_int_distribution<size_t>(lo, hi)(random);
+            } else {
+                node.Arity = node.Length = lo;
+            }
+        }
+
         return node;
     }
 
 private:
     NodeType config = Grammar::Arithmetic;
     std::array<size_t, Operon::NodeTypes::Count> frequencies;
+    size_t maximumArity = 2;
 };
 
 }
@@ -0,0 +1,85 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include <vector>
+
+#include "core/plan.hpp"
+
+namespace Operon {
+// native code generated at runtime for an evaluation plan: the whole tree is fused into a single loop over the rows
+// which keeps the intermediate values in registers (4 rows per iteration with AVX2), instead of interpreting the
+// instructions batch by batch with a round trip through the scratch buffer for every node
+// - only x86-64 (linux) with AVX2 is supported, and only the arithmetic subset of the plans (constants, variables,
+//   n-ary Add and Mul, Sub, Div, Square and Sqrt) whose stack layout fits in the 15 available vector registers; Compile
+//   returns false for the others, which are to be evaluated with the interpreter
+// - the results are those of the interpreter, except for Sqrt which is correctly rounded here while the
+//   interpreter's vectorized square root may differ in the last bit
+// - the code points to the plan, which must outlive it and must not be recompiled in the meantime; the plan
+//   coefficients may change however (they are read at every evaluation, eg. during a local search)
+// - generating the code costs about as much as a few interpretations of the plan (and two mprotect calls), so it
+//   pays off for plans which are evaluated many times, such as the residual evaluations of a local search (see
+//   ReverseModeCostFunction::Native)
+class NativePlan {
+public:
+    NativePlan() = default;
+    ~NativePlan();
+
+    NativePlan(const NativePlan&) = delete;
+    NativePlan& operator=(const NativePlan&) = delete;
+
+    // whether native code can be generated on this platform and processor
+    static bool Supported() noexcept;
+
+    // (re)generates the code for the plan, reusing the already allocated memory; returns false if the plan
+    // is not supported, in which case the native plan is empty
+    bool Compile(const EvaluationPlan& plan);
+
+    // empties the native plan
+    void Clear() noexcept
+    {
+        plan = nullptr;
+        function = nullptr;
+        size = 0;
+    }
+
+    bool IsCompiled() const noexcept { return function != nullptr; }
+    // the plan the code was generated for (nullptr if there is no code)
+    const EvaluationPlan* Plan() const noexcept { return plan; }
+    size_t CodeSize() const noexcept { return size; }
+
+    // same semantics as the interpreter's Evaluate(plan, range, parameters, result)
+    void Evaluate(Range range, Operon::Scalar const* parameters, gsl::span<Operon::Scalar> result) const;
+
+private:
+    // columns: the data column of every variable instruction (offset to the first row), by instruction index
+    // values: the constant value or variable weight of every instruction, by instruction index
+    using Function = void (*)(Operon::Scalar const* const* columns, Operon::Scalar* result, Operon::Scalar const* values, size_t rows);
+
+    const EvaluationPlan* plan = nullptr;
+    Function function = nullptr;
+    void* memory = nullptr;
+    size_t capacity = 0;
+    size_t size = 0;
+};
+} // namespace Operon
+
+#endif
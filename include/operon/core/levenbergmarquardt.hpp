@@ -0,0 +1,94 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#ifndef LEVENBERG_MARQUARDT_HPP
+#define LEVENBERG_MARQUARDT_HPP
+
+#include "core/eval.hpp"
+
+namespace Operon {
+// Levenberg-Marquardt solver for the small dense least squares problems arising from tree coefficients (tens of
+// parameters), as a lightweight alternative to setting up a ceres::Problem for every individual
+// - the normal equations J'J and J'r are accumulated batch by batch from the reverse-mode Jacobian, so the memory
+//   footprint does not depend on the number of rows
+// - all the storage is kept between calls, so that optimizing with the thread-local instance does not allocate
+//   once the solver has seen the largest problem
+// - each trial step is evaluated together with its normal equations, so accepting it costs no extra evaluation
+// - like ceres' max_num_iterations, the iteration budget counts rejected steps as well
+// - rows where the model is not finite are ignored (they contribute neither to the cost nor to the normal equations)
+class LevenbergMarquardtSolver {
+public:
+    struct Summary {
+        size_t Iterations = 0; // solver iterations (accepted and rejected steps), bounded by the iteration budget
+        size_t SuccessfulSteps = 0; // accepted steps (ceres' num_successful_steps)
+        size_t Evaluations = 0; // cost function evaluations
+        double InitialCost = 0;
+        double FinalCost = 0;
+        bool Converged = false;
+    };
+
+    // same defaults as ceres
+    static constexpr double FunctionTolerance = 1e-6;
+    static constexpr double GradientTolerance = 1e-10;
+    static constexpr double ParameterTolerance = 1e-8;
+
+    static LevenbergMarquardtSolver& Local() noexcept
+    {
+        thread_local LevenbergMarquardtSolver solver;
+        return solver;
+    }
+
+    Summary Optimize(Tree& tree, EvaluationPlan& plan, const gsl::span<const Operon::Scalar> targetValues, const Range range, size_t iterations = 50, bool writeCoefficients = true);
+    // fits the rows of an index set, the target values being given in the same order
+    Summary Optimize(Tree& tree, EvaluationPlan& plan, const gsl::span<const Operon::Scalar> targetValues, gsl::span<const gsl::index> rows, size_t iterations = 50, bool writeCoefficients = true);
+
+private:
+    // runs the iterations on the problem the cost function is bound to
+    Summary Solve(Tree& tree, EvaluationPlan& plan, size_t iterations, bool writeCoefficients);
+
+    // returns the cost 1/2 * sum(r^2) for the given coefficients and, if jtjOut is not null, writes the normal
+    // equations (lower triangle of J'J and J'r) into jtjOut and jtrOut
+    double Evaluate(double const* coefficients, double* jtjOut, double* jtrOut);
+
+    ReverseModeCostFunction cost;
+    std::vector<double> x; // current coefficients
+    Operon::Vector<double> candidate; // coefficients after a step
+    Operon::Vector<double> jtj; // J'J (lower triangle)
+    Operon::Vector<double> jtr; // J'r
+    Operon::Vector<double> candidateJtj; // J'J at the candidate coefficients
+    Operon::Vector<double> candidateJtr; // J'r at the candidate coefficients
+    Operon::Vector<double> system; // damped J'J to be factorized in place
+    Operon::Vector<double> step;
+    Operon::Vector<double> jacobian; // Jacobian block of a batch
+    Operon::Vector<double> residuals; // residuals of a batch
+};
+
+// convenience wrapper using the solver of the calling thread
+inline LevenbergMarquardtSolver::Summary OptimizeLevenbergMarquardt(Tree& tree, EvaluationPlan& plan, const gsl::span<const Operon::Scalar> targetValues, const Range range, size_t iterations = 50, bool writeCoefficients = true)
+{
+    return LevenbergMarquardtSolver::Local().Optimize(tree, plan, targetValues, range, iterations, writeCoefficients);
+}
+
+inline LevenbergMarquardtSolver::Summary OptimizeLevenbergMarquardt(Tree& tree, EvaluationPlan& plan, const gsl::span<const Operon::Scalar> targetValues, gsl::span<const gsl::index> rows, size_t iterations = 50, bool writeCoefficients = true)
+{
+    return LevenbergMarquardtSolver::Local().Optimize(tree, plan, targetValues, rows, iterations, writeCoefficients);
+}
+} // namespace Operon
+
+#endif
@@ -0,0 +1,208 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#ifndef MATH_HPP
+#define MATH_HPP
+
+#include <Eigen/Core>
+#include <ceres/ceres.h>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+// vectorized kernels for the unary primitives which Eigen does not vectorize itself (cbrt, tan and double precision
+// sin/cos). the kernels are written in terms of Eigen's packet primitives, so they are compiled to SSE, AVX2 or
+// AVX-512 instructions depending on the target architecture. scalar types without packet support (eg. ceres::Jet)
+// fall back to the scalar operator()
+namespace Operon {
+namespace Math {
+    namespace detail {
+        template <typename T>
+        constexpr bool IsVectorizable = (std::is_same_v<T, float> || std::is_same_v<T, double>) && Eigen::internal::packet_traits<T>::Vectorizable;
+
+        // sin and cos in double precision: Cody-Waite reduction by pi/4 followed by the Cephes minimax polynomials
+        // the reduction is accurate for |x| < 2^30, which is well beyond the range of values encountered in practice
+        template <typename Packet>
+        inline std::pair<Packet, Packet> psincos_double(const Packet& x)
+        {
+            using namespace Eigen::internal;
+            const Packet zero = pzero(x);
+            const Packet one = pset1<Packet>(1.0);
+            const Packet two = pset1<Packet>(2.0);
+            const Packet four = pset1<Packet>(4.0);
+            const Packet six = pset1<Packet>(6.0);
+            const Packet half = pset1<Packet>(0.5);
+
+            Packet a = pabs(x);
+            // octant index rounded up to an even number such that the reduced argument z lies in [-pi/4, pi/4]
+            Packet j = pmul(two, pfloor(pmul(padd(pmul(a, pset1<Packet>(1.27323954473516268615)), one), half)));
+            Packet z = psub(a, pmul(j, pset1<Packet>(7.85398125648498535156E-1)));
+            z = psub(z, pmul(j, pset1<Packet>(3.77489470793079817668E-8)));
+            z = psub(z, pmul(j, pset1<Packet>(2.69515142907905952645E-15)));
+            Packet q = psub(j, pmul(pset1<Packet>(8.0), pfloor(pmul(j, pset1<Packet>(0.125))))); // j mod 8, one of {0, 2, 4, 6}
+            Packet zz = pmul(z, z);
+
+            Packet ps = pset1<Packet>(1.58962301576546568060E-10);
+            ps = pmadd(ps, zz, pset1<Packet>(-2.50507477628578072866E-8));
+            ps = pmadd(ps, zz, pset1<Packet>(2.75573136213857245213E-6));
+            ps = pmadd(ps, zz, pset1<Packet>(-1.98412698295895385996E-4));
+            ps = pmadd(ps, zz, pset1<Packet>(8.33333333332211858878E-3));
+            ps = pmadd(ps, zz, pset1<Packet>(-1.66666666666666307295E-1));
+            Packet sinz = pmadd(pmul(z, zz), ps, z);
+
+            Packet pc = pset1<Packet>(-1.13585365213876817300E-11);
+            pc = pmadd(pc, zz, pset1<Packet>(2.08757008419747316778E-9));
+            pc = pmadd(pc, zz, pset1<Packet>(-2.75573141792967388112E-7));
+            pc = pmadd(pc, zz, pset1<Packet>(2.48015872888517045348E-5));
+            pc = pmadd(pc, zz, pset1<Packet>(-1.38888888888730564116E-3));
+            pc = pmadd(pc, zz, pset1<Packet>(4.16666666666665929218E-2));
+            Packet cosz = padd(psub(one, pmul(half, zz)), pmul(pmul(zz, zz), pc));
+
+            // in octants 2 and 6 the roles of sin and cos are swapped
+            Packet swap = por(pcmp_eq(q, two), pcmp_eq(q, six));
+            Packet s = pselect(swap, cosz, sinz);
+            Packet c = pselect(swap, sinz, cosz);
+
+            // sin is odd and negative in octants 4 and 6; cos is negative in octants 2 and 4
+            Packet sneg = pxor(pcmp_le(four, q), pcmp_lt(x, zero));
+            Packet cneg = por(pcmp_eq(q, two), pcmp_eq(q, four));
+            return { pselect(sneg, pnegate(s), s), pselect(cneg, pnegate(c), c) };
+        }
+    } // namespace detail
+
+    template <typename T>
+    struct Sin {
+        T operator()(const T& x) const
+        {
+            using std::sin;
+            return sin(x);
+        }
+
+        template <typename Packet>
+        Packet packetOp(const Packet& x) const
+        {
+            if constexpr (std::is_same_v<T, double>) {
+                return detail::psincos_double(x).first;
+            } else {
+                return Eigen::internal::psin(x);
+            }
+        }
+    };
+
+    template <typename T>
+    struct Cos {
+        T operator()(const T& x) const
+        {
+            using std::cos;
+            return cos(x);
+        }
+
+        template <typename Packet>
+        Packet packetOp(const Packet& x) const
+        {
+            if constexpr (std::is_same_v<T, double>) {
+                return detail::psincos_double(x).second;
+            } else {
+                return Eigen::internal::pcos(x);
+            }
+        }
+    };
+
+    template <typename T>
+    struct Tan {
+        T operator()(const T& x) const
+        {
+            using std::tan;
+            return tan(x);
+        }
+
+        template <typename Packet>
+        Packet packetOp(const Packet& x) const
+        {
+            if constexpr (std::is_same_v<T, double>) {
+                auto [s, c] = detail::psincos_double(x);
+                return Eigen::internal::pdiv(s, c);
+            } else {
+                return Eigen::internal::pdiv(Eigen::internal::psin(x), Eigen::internal::pcos(x));
+            }
+        }
+    };
+
+    // cbrt(x) = sign(x) * exp(log(|x|) / 3), refined by one Newton-Raphson step
+    template <typename T>
+    struct Cbrt {
+        T operator()(const T& x) const
+        {
+            return T(ceres::cbrt(x));
+        }
+
+        template <typename Packet>
+        Packet packetOp(const Packet& x) const
+        {
+            using namespace Eigen::internal;
+            const Packet zero = pzero(x);
+            const Packet inf = pset1<Packet>(std::numeric_limits<T>::infinity());
+            Packet a = pabs(x);
+            Packet y = pexp(pmul(plog(a), pset1<Packet>(T(1) / T(3))));
+            Packet y2 = pmul(y, y);
+            y = psub(y, pdiv(psub(pmul(y2, y), a), pmul(pset1<Packet>(T(3)), y2)));
+            // the Newton step is undefined for zero and infinite values, which are their own cube roots
+            y = pselect(por(pcmp_eq(a, zero), pcmp_eq(a, inf)), a, y);
+            return pselect(pcmp_lt(x, zero), pnegate(y), y);
+        }
+    };
+} // namespace Math
+} // namespace Operon
+
+namespace Eigen {
+namespace internal {
+    template <typename T>
+    struct functor_traits<Operon::Math::Sin<T>> {
+        enum {
+            Cost = 30 * NumTraits<T>::MulCost,
+            PacketAccess = Operon::Math::detail::IsVectorizable<T> && (std::is_same_v<T, double> || packet_traits<T>::HasSin)
+        };
+    };
+
+    template <typename T>
+    struct functor_traits<Operon::Math::Cos<T>> {
+        enum {
+            Cost = 30 * NumTraits<T>::MulCost,
+            PacketAccess = Operon::Math::detail::IsVectorizable<T> && (std::is_same_v<T, double> || packet_traits<T>::HasCos)
+        };
+    };
+
+    template <typename T>
+    struct functor_traits<Operon::Math::Tan<T>> {
+        enum {
+            Cost = 40 * NumTraits<T>::MulCost,
+            PacketAccess = Operon::Math::detail::IsVectorizable<T> && (std::is_same_v<T, double> || (packet_traits<T>::HasSin && packet_traits<T>::HasCos))
+        };
+    };
+
+    template <typename T>
+    struct functor_traits<Operon::Math::Cbrt<T>> {
+        enum {
+            Cost = 40 * NumTraits<T>::MulCost,
+            PacketAccess = Operon::Math::detail::IsVectorizable<T> && packet_traits<T>::HasExp && packet_traits<T>::HasLog
+        };
+    };
+} // namespace internal
+} // namespace Eigen
+#endif
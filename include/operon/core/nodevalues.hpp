@@ -0,0 +1,80 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#ifndef NODE_VALUES_HPP
+#define NODE_VALUES_HPP
+
+#include <vector>
+
+#include "core/dataset.hpp"
+#include "core/tree.hpp"
+
+namespace Operon {
+// the values of every node of a tree over a range (column i holds the output of the subtree rooted at node i),
+// retained for a parent such that its offspring, which mostly differ from it in a single subtree (eg. after subtree
+// crossover or one point mutation), can be evaluated incrementally by reading the values of the unchanged subtrees
+// instead of recomputing them (see EvaluateIncremental). this takes Length() * range.Size() values
+class NodeValues {
+public:
+    NodeValues() = default;
+    NodeValues(const Tree& tree, const Dataset& dataset, Range range) { Compute(tree, dataset, range); }
+
+    // evaluates the tree, reusing the already allocated storage
+    void Compute(const Tree& tree, const Dataset& dataset, Range range);
+
+    Range GetRange() const noexcept { return range; }
+    size_t Length() const noexcept { return nodes.size(); }
+    const std::vector<Node>& Nodes() const noexcept { return nodes; }
+    const Operon::Scalar* Column(gsl::index i) const noexcept { return values.data() + i * range.Size(); }
+
+    // lengths of the longest common prefix and suffix of the node sequences of the given tree and the retained one,
+    // compared by structure only (node types, hashes and arities, but not coefficients)
+    std::pair<size_t, size_t> CommonAffixes(const Tree& other) const noexcept
+    {
+        auto const& others = other.Nodes();
+        auto same = [](const Node& a, const Node& b) {
+            return a.Type == b.Type && a.HashValue == b.HashValue && a.Arity == b.Arity;
+        };
+        auto n = std::min(nodes.size(), others.size());
+        size_t prefix = 0;
+        while (prefix < n && same(nodes[prefix], others[prefix])) {
+            ++prefix;
+        }
+        size_t suffix = 0;
+        while (suffix < n - prefix && same(nodes[nodes.size() - 1 - suffix], others[others.size() - 1 - suffix])) {
+            ++suffix;
+        }
+        return { prefix, suffix };
+    }
+
+    // finds the largest subtrees of the given tree which have the same values as the subtree at the same position
+    // of the retained tree: those lying entirely within a common affix whose coefficients are all unchanged
+    // appends (node index in other, retained column) for each of them to loads if it is not null, from the last
+    // node to the first, and returns the number of nodes they span
+    // with local optimization, an offspring rarely keeps the coefficients of its parent, and little is shared
+    size_t SharedSubtrees(const Tree& other, std::vector<std::pair<gsl::index, Operon::Scalar const*>>* loads = nullptr) const;
+
+private:
+    std::vector<Node> nodes;
+    Range range;
+    Operon::Vector<Operon::Scalar> values;
+};
+} // namespace Operon
+
+#endif
@@ -21,13 +21,21 @@
 #define OPERATOR_HPP
 
 #include "gsl/gsl"
+#include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <numeric>
+#include <optional>
 #include <random>
 
 #include "common.hpp"
 #include "dataset.hpp"
+#include "fitnesscache.hpp"
 #include "grammar.hpp"
+#include "nodevalues.hpp"
 #include "problem.hpp"
+#include "stat/meanvariance.hpp"
+#include "subtreecache.hpp"
 #include "tree.hpp"
 
 namespace Operon {
@@ -70,10 +78,32 @@ struct CreatorBase : public OperatorBase<Tree, const Grammar&, const gsl::span<c
 
 // crossover takes two parent trees and returns a child
 struct CrossoverBase : public OperatorBase<Tree, const Tree&, const Tree&> {
+    using OperatorBase<Tree, const Tree&, const Tree&>::operator();
+
+    // writes the child into the given tree (which must not be one of the parents), reusing its storage
+    virtual void operator()(Operon::Random& random, const Tree& lhs, const Tree& rhs, Tree& child) const
+    {
+        child = (*this)(random, lhs, rhs);
+    }
+
+    // the parents are sorted in the given hash mode: the hashes of the child are then updated incrementally,
+    // along the path from the insertion point to the root (see Tree::Sort(gsl::index, HashMode))
+    void MaintainHashes(std::optional<Operon::HashMode> mode) { hashMode = mode; }
+    std::optional<Operon::HashMode> MaintainHashes() const { return hashMode; }
+
+protected:
+    std::optional<Operon::HashMode> hashMode;
 };
 
 // the mutator can work in place or return a copy (child)
 struct MutatorBase : public OperatorBase<Tree, Tree> {
+    // the input trees are sorted in the given hash mode and the mutated trees are kept sorted, updating only
+    // the hashes of the mutated nodes and their ancestors
+    void MaintainHashes(std::optional<Operon::HashMode> mode) { hashMode = mode; }
+    std::optional<Operon::HashMode> MaintainHashes() const { return hashMode; }
+
+protected:
+    std::optional<Operon::HashMode> hashMode;
 };
 
 // the selector a vector of individuals and returns the index of a selected individual per each call of operator()
@@ -99,6 +129,18 @@ template <typename T, gsl::index Idx>
 class ReinserterBase : public OperatorBase<void, std::vector<T>&, std::vector<T>&> {
 };
 
+// method used by the evaluators for the local optimization of tree coefficients
+enum class LocalOptimizer {
+    LevenbergMarquardt, // native solver (see core/levenbergmarquardt.hpp), opt-in
+    Ceres // ceres::Solver with reverse-mode Jacobians (the default)
+};
+
+// selection of the training rows used for local optimization when it runs on a subset of the data
+enum class RowSampling {
+    Random, // uniformly at random without replacement
+    Stratified // one row from each of the equally sized strata of the training rows sorted by target value
+};
+
 template <typename T>
 class EvaluatorBase : public OperatorBase<Operon::Scalar, T&> {
     // some fitness measures are relative to the whole population (eg. diversity)
@@ -117,10 +159,147 @@ public:
     size_t TotalEvaluations() const { return fitnessEvaluations + localEvaluations; }
     size_t FitnessEvaluations() const { return fitnessEvaluations; }
     size_t LocalEvaluations() const { return localEvaluations; }
+    // evaluations answered by the fitness cache (these are also counted as fitness evaluations, such that the
+    // budget and the selection pressure are charged for duplicate offspring)
+    size_t CachedEvaluations() const { return cachedEvaluations; }
 
     void LocalOptimizationIterations(size_t value) { iterations = value; }
     size_t LocalOptimizationIterations() const { return iterations; }
 
+    void LocalOptimizationMethod(LocalOptimizer value) { optimizer = value; }
+    LocalOptimizer LocalOptimizationMethod() const { return optimizer; }
+
+    // number of training rows used for local optimization (0 means all the training rows)
+    // fitness is always calculated on the whole training range
+    void LocalOptimizationSampleSize(size_t value) { sampleSize = value; }
+    size_t LocalOptimizationSampleSize() const { return sampleSize; }
+
+    void LocalOptimizationSampling(RowSampling value) { sampling = value; }
+    RowSampling LocalOptimizationSampling() const { return sampling; }
+
+    // the current sample of training rows for local optimization or nullptr if all the rows are to be used
+    const Dataset* LocalOptimizationSample() const { return sample.has_value() ? &sample.value() : nullptr; }
+
+    // number of training rows used to race candidates against a fitness threshold (0 disables racing)
+    // see operator()(random, ind, threshold) below
+    void RacingSampleSize(size_t value) { racingSampleSize = value; }
+    size_t RacingSampleSize() const { return racingSampleSize; }
+
+    // half-width of the confidence interval for the racing estimate, in standard errors
+    void RacingConfidence(Operon::Scalar value) { racingConfidence = value; }
+    Operon::Scalar RacingConfidence() const { return racingConfidence; }
+
+    // the current racing sample or nullptr if racing is disabled
+    const Dataset* RacingSample() const { return racingSample.has_value() ? &racingSample.value() : nullptr; }
+
+    // number of candidates rejected on the racing sample, without local optimization or a full evaluation
+    size_t RacingRejections() const { return racingRejections; }
+
+    // optional cache of subtree values shared by the evaluations on the training range (nullptr disables caching)
+    // the cache is not owned by the evaluator
+    void Cache(SubtreeCache* value) { cache = value; }
+    SubtreeCache* Cache() const { return cache; }
+
+    // optional cache of the fitness of already evaluated trees (nullptr disables memoization)
+    // when enabled the genotypes are sorted (see Tree::Sort) to obtain their strict hash before evaluation, unless
+    // they are already sorted (see Sorted below)
+    // the cache is not owned by the evaluator
+    void Memoization(FitnessCache* value) { fitnessCache = value; }
+    FitnessCache* Memoization() const { return fitnessCache; }
+
+    // the genotypes are kept sorted in strict hash mode (by the initialization and the variation operators, see
+    // MaintainHashes), so memoization uses their hash as it is instead of sorting them again. the evaluator keeps
+    // them sorted in turn: a genotype is sorted again after each change that the variation operators do not see
+    // (simplification, local optimization or coefficients restored from the fitness cache)
+    void Sorted(bool value) { sorted = value; }
+    bool Sorted() const { return sorted; }
+
+    // number of the best parents whose node values on the training range are retained (see Retain) such that their
+    // offspring can be evaluated incrementally; every retained parent takes Length() * (training rows) values
+    // index sets of training rows are not supported and disable the retention
+    // only the subtrees whose coefficients are unchanged are reused: with local optimization (which usually adjusts
+    // every coefficient of the offspring) few evaluations are incremental
+    void RetainedParents(size_t value) { retainedParents = value; }
+    size_t RetainedParents() const { return retainedParents; }
+
+    // trees of at least this length whose coefficients are optimized with ceres on the training range are evaluated
+    // with native code generated at runtime, if their plan is supported (see NativePlan), instead of the interpreter:
+    // the code is generated once and used for the residual evaluations of the local search and the final evaluation
+    // (0 disables native code). code generation does not pay off for a single evaluation, so it is not used otherwise
+    void JitThreshold(size_t value) { jitThreshold = value; }
+    size_t JitThreshold() const { return jitThreshold; }
+
+    // simplify the genotypes (see Tree::Simplify) before local optimization and evaluation; the simplified tree
+    // replaces the genotype of the individual
+    void Simplification(bool value) { simplify = value; }
+    bool Simplification() const { return simplify; }
+
+    // evaluations which reused the retained node values of a parent
+    size_t IncrementalEvaluations() const { return incrementalEvaluations; }
+
+    // retains the node values of the best parents by the given objective (eg. once per generation)
+    // this is not thread-safe and must not be called while individuals are being evaluated
+    void Retain(gsl::span<const T> parents, gsl::index objective = 0)
+    {
+        auto const& p = problem.get();
+        if (retainedParents == 0 || !p.TrainingRows().empty()) {
+            retained.clear();
+            return;
+        }
+        auto k = std::min(retainedParents, parents.size());
+        std::vector<gsl::index> order(parents.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::partial_sort(order.begin(), order.begin() + k, order.end(), [&](auto a, auto b) { return parents[a][objective] < parents[b][objective]; });
+        // the storage of the previously retained parents is reused
+        retained.resize(k);
+        for (size_t i = 0; i < k; ++i) {
+            retained[i].Compute(parents[order[i]].Genotype, p.GetDataset(), p.TrainingRange());
+        }
+    }
+
+    // draws new samples of training rows for local optimization and racing (eg. once per generation)
+    // this is not thread-safe and must not be called while individuals are being evaluated
+    void Resample(Operon::Random& random)
+    {
+        auto const& p = problem.get();
+        auto range = p.TrainingRange();
+
+        if (sampleSize == 0 || sampleSize >= range.Size()) {
+            sample.reset();
+        } else {
+            DrawRows(random, sampleSize, sampling);
+            sample.emplace(p.GetDataset().Subset(rows));
+        }
+
+        if (racingSampleSize == 0 || racingSampleSize >= range.Size()) {
+            racingSample.reset();
+        } else {
+            DrawRows(random, racingSampleSize, RowSampling::Random);
+            racingSample.emplace(p.GetDataset().Subset(rows));
+            // the racing estimates are normalized with the statistics of the whole training partition
+            MeanVarianceCalculator calc;
+            if (auto indices = p.TrainingRows(); !indices.empty()) {
+                auto target = p.TargetValues();
+                for (auto i : indices) {
+                    calc.Add(target[i]);
+                }
+            } else {
+                calc.Add(p.TargetValues().subspan(range.Start(), range.Size()));
+            }
+            racingTargetVariance = calc.NaiveVariance();
+        }
+    }
+
+    // evaluates the individual with early rejection (racing): when a racing sample is available, the
+    // fitness is first estimated on the sample and if its confidence interval lies entirely above the
+    // threshold the estimate is returned without optimizing the coefficients or evaluating on the whole training range
+    // the default implementation ignores the threshold
+    using OperatorBase<Operon::Scalar, T&>::operator();
+    virtual Operon::Scalar operator()(Operon::Random& random, T& ind, Operon::Scalar) const
+    {
+        return (*this)(random, ind);
+    }
+
     void Budget(size_t value) { budget = value; }
     size_t Budget() const { return budget; }
     bool BudgetExhausted() const { return TotalEvaluations() > Budget(); }
@@ -129,15 +308,131 @@ public:
     {
         fitnessEvaluations = 0;
         localEvaluations = 0;
+        cachedEvaluations = 0;
+        incrementalEvaluations = 0;
+        racingRejections = 0;
     }
 
 protected:
+    // looks the individual up in the fitness cache, returning its fitness on a hit (the cached coefficients are
+    // then written to the genotype); key receives the strict hash to pass to Remember after the evaluation
+    std::optional<Operon::Scalar> Recall(T& ind, Operon::Hash& key) const
+    {
+        if (fitnessCache == nullptr) {
+            return std::nullopt;
+        }
+        auto& genotype = ind.Genotype;
+        key = sorted ? genotype.HashValue() : genotype.Sort(Operon::HashMode::Strict).HashValue();
+        thread_local FitnessCache::Entry entry;
+        // a hash collision between trees with different numbers of coefficients is treated as a miss
+        if (!fitnessCache->Find(key, entry) || entry.Coefficients.size() != genotype.CoefficientsCount()) {
+            return std::nullopt;
+        }
+        genotype.SetCoefficients(entry.Coefficients);
+        if (sorted) {
+            genotype.Sort(Operon::HashMode::Strict);
+        }
+        ++fitnessEvaluations;
+        ++cachedEvaluations;
+        return entry.Fitness;
+    }
+
+    // adds the fitness of the individual evaluated under the given key (see Recall) to the fitness cache
+    void Remember(Operon::Hash key, const T& ind, Operon::Scalar fitness) const
+    {
+        if (fitnessCache == nullptr) {
+            return;
+        }
+        thread_local FitnessCache::Entry entry;
+        entry.Fitness = fitness;
+        entry.Coefficients = ind.Genotype.GetCoefficients();
+        fitnessCache->Insert(key, entry);
+    }
+
+    // simplifies the genotype if enabled (sorting it again if it is kept sorted, see Sorted)
+    void Simplify(T& ind) const
+    {
+        if (!simplify) {
+            return;
+        }
+        ind.Genotype.Simplify();
+        if (sorted) {
+            ind.Genotype.Sort(Operon::HashMode::Strict);
+        }
+    }
+
+    // sorts the genotype again after local optimization if it is kept sorted (see Sorted); this must come after
+    // Remember, as the cached coefficients are in the order of the genotype looked up by Recall
+    void Resort(T& ind) const
+    {
+        if (sorted && iterations > 0) {
+            ind.Genotype.Sort(Operon::HashMode::Strict);
+        }
+    }
+
     gsl::span<const T> population;
     std::reference_wrapper<const Problem> problem;
     mutable std::atomic_ulong fitnessEvaluations = 0;
     mutable std::atomic_ulong localEvaluations = 0;
+    mutable std::atomic_ulong cachedEvaluations = 0;
+    mutable std::atomic_ulong incrementalEvaluations = 0;
     size_t iterations = DefaultLocalOptimizationIterations;
     size_t budget = DefaultEvaluationBudget;
+    LocalOptimizer optimizer = LocalOptimizer::Ceres;
+    size_t sampleSize = 0;
+    RowSampling sampling = RowSampling::Random;
+    size_t racingSampleSize = 0;
+    Operon::Scalar racingConfidence = 3;
+    Operon::Scalar racingTargetVariance = 0;
+    mutable std::atomic_ulong racingRejections = 0;
+    SubtreeCache* cache = nullptr;
+    FitnessCache* fitnessCache = nullptr;
+    size_t retainedParents = 0;
+    size_t jitThreshold = 0;
+    bool simplify = false;
+    bool sorted = false;
+    std::vector<NodeValues> retained;
+    std::vector<gsl::index> rows;
+    std::optional<Dataset> sample;
+    std::optional<Dataset> racingSample;
+
+private:
+    // fills rows with n sorted indices drawn from the training range (or index set)
+    void DrawRows(Operon::Random& random, size_t n, RowSampling method)
+    {
+        auto const& p = problem.get();
+        auto range = p.TrainingRange();
+        auto m = range.Size();
+        if (auto indices = p.TrainingRows(); !indices.empty()) {
+            rows.assign(indices.begin(), indices.end());
+        } else {
+            rows.resize(m);
+            std::iota(rows.begin(), rows.end(), static_cast<gsl::index>(range.Start()));
+        }
+        if (method == RowSampling::Random) {
+            // partial Fisher-Yates shuffle
+            for (size_t i = 0; i < n; ++i) {
+                std::uniform_int_distribution<size_t> dist(i, m - 1);
+                std::swap(rows[i], rows[dist(random)]);
+            }
+        } else {
+            // rows with a non-finite target have no rank (and would break the ordering), so they are moved to the end
+            // and only used to fill the sample when there are fewer than n finite targets
+            auto target = p.TargetValues();
+            auto mid = std::partition(rows.begin(), rows.end(), [&](auto i) { return std::isfinite(target[i]); });
+            std::sort(rows.begin(), mid, [&](auto a, auto b) { return target[a] < target[b]; });
+            auto finite = static_cast<size_t>(std::distance(rows.begin(), mid));
+            if (finite >= n) {
+                for (size_t i = 0; i < n; ++i) {
+                    // stratum i spans the ranks [lo, hi) with lo >= i, so the rows of later strata are not overwritten
+                    std::uniform_int_distribution<size_t> dist(i * finite / n, (i + 1) * finite / n - 1);
+                    rows[i] = rows[dist(random)];
+                }
+            }
+        }
+        rows.resize(n);
+        std::sort(rows.begin(), rows.end());
+    }
 };
 
 // TODO: Maybe remove all the template parameters and go for accepting references to operator bases
@@ -176,6 +471,17 @@ public:
     }
     virtual bool Terminate() const { return evaluator.get().BudgetExhausted(); }
 
+    // writes an offspring into the given individual, reusing the storage of its genotype (eg. the individual of the
+    // recombination pool it replaces), and returns false if no offspring was produced
+    virtual bool Generate(Operon::Random& random, double pCrossover, double pMutation, T& child) const
+    {
+        if (auto result = (*this)(random, pCrossover, pMutation); result.has_value()) {
+            child = std::move(result.value());
+            return true;
+        }
+        return false;
+    }
+
 protected:
     std::reference_wrapper<TEvaluator> evaluator;
     std::reference_wrapper<TCrossover> crossover;
@@ -0,0 +1,100 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#ifndef PLAN_HPP
+#define PLAN_HPP
+
+#include <vector>
+
+#include "core/dataset.hpp"
+#include "core/tree.hpp"
+
+namespace Operon {
+// layout of the scratch buffer used by the interpreter
+// - Linear: one buffer column per node
+// - Stack: columns are reused according to the liveness of intermediate results in the postfix sequence
+//          (equivalent to a stack machine), so the buffer size is bounded by the maximum stack depth
+enum class BufferLayout {
+    Linear,
+    Stack
+};
+
+// a single step of a compiled evaluation program
+struct Instruction {
+    NodeType Type;
+    uint16_t Arity;
+    uint16_t Length; // number of descendants, the subtree spans the instructions [i - Length, i]
+    gsl::index Column; // buffer column receiving the result
+    gsl::index Operands; // offset of the child columns in the plan's operand list
+    gsl::index Coefficient; // index in the coefficient (parameter) vector, -1 if there is none
+    Operon::Scalar Value; // constant value or variable weight
+    Operon::Scalar const* Data; // data column of a variable node (nullptr otherwise)
+    float const* SingleData; // single precision data column, if the dataset caches one (nullptr otherwise)
+    Operon::Scalar* Output; // if set, the result is also written to this column (see SubtreeCache)
+};
+
+// an evaluation plan is a tree compiled against a dataset: the postfix node sequence is flattened into an
+// instruction stream with pre-resolved child columns, dataset columns and coefficient slots, such that it
+// can be built once and reused for many evaluations (eg. all the residual evaluations of a local search)
+// the plan points into the dataset's storage so the dataset must outlive the plan
+class EvaluationPlan {
+public:
+    EvaluationPlan() = default;
+    EvaluationPlan(const Tree& tree, const Dataset& dataset, BufferLayout layout = BufferLayout::Stack);
+
+    // (re)compiles the plan in place, reusing the already allocated storage
+    void Compile(const Tree& tree, const Dataset& dataset, BufferLayout layout = BufferLayout::Stack);
+
+    const std::vector<Instruction>& Instructions() const noexcept { return instructions; }
+    const Instruction& operator[](gsl::index i) const noexcept { return instructions[i]; }
+
+    // returns the buffer columns of the instruction's children (in the same order as Tree::Children)
+    const gsl::index* Operands(const Instruction& instruction) const noexcept { return operands.data() + instruction.Operands; }
+
+    size_t Length() const noexcept { return instructions.size(); }
+    size_t BufferSize() const noexcept { return bufferSize; } // number of scratch buffer columns required
+    BufferLayout Layout() const noexcept { return layout; }
+    size_t CoefficientsCount() const noexcept { return coefficientsCount; }
+
+    std::vector<Operon::Scalar> GetCoefficients() const;
+    void SetCoefficients(gsl::span<const Operon::Scalar> coefficients);
+
+    // strict hash of the subtree rooted at each instruction, which depends on the structure, on the coefficient
+    // values and on the variables and the current version of the dataset (subtrees with equal hashes evaluate to the
+    // same values); not available for derived plans
+    void SubtreeHashes(std::vector<Operon::Hash>& hashes) const;
+
+    // (re)compiles the plan as a copy of another plan for evaluation over the given range, where the subtrees rooted
+    // at the `loads` instructions are replaced by reads of the given columns (of range size) and the results of the
+    // `stores` instructions are also written to the given columns; both lists must be sorted by instruction index
+    // and the loaded subtrees must be disjoint. the copy is to be evaluated over Range { 0, range.Size() }
+    void Derive(const EvaluationPlan& plan, Range range, gsl::span<const std::pair<gsl::index, Operon::Scalar const*>> loads, gsl::span<const std::pair<gsl::index, Operon::Scalar*>> stores);
+
+private:
+    std::vector<Instruction> instructions;
+    std::vector<Operon::Hash> hashes; // node hash values
+    std::vector<gsl::index> operands;
+    const Dataset* dataset = nullptr; // the dataset the plan was compiled against (nullptr for derived plans)
+    size_t coefficientsCount = 0;
+    size_t bufferSize = 0;
+    BufferLayout layout = BufferLayout::Stack;
+};
+} // namespace Operon
+
+#endif
@@ -48,10 +48,23 @@ public:
         std::sort(inputVariables.begin(), inputVariables.end(), [](const auto& lhs, const auto& rhs) { return lhs.Hash < rhs.Hash; });
     }
 
+    // partitions given as row index sets (eg. cross-validation folds or bootstrap samples) which are evaluated in
+    // place, without copying the rows out of the dataset; the ranges then refer to positions within the index sets
+    Problem(const Dataset& ds, gsl::span<const Variable> allVariables, std::string targetVariable, std::vector<gsl::index> trainingRows, std::vector<gsl::index> testRows)
+        : Problem(ds, allVariables, targetVariable, Range { 0, trainingRows.size() }, Range { 0, testRows.size() })
+    {
+        trainingIndices = std::move(trainingRows);
+        testIndices = std::move(testRows);
+    }
+
     Range TrainingRange() const { return training; }
     Range TestRange() const { return test; }
     Range ValidationRange() const { return validation; }
 
+    // the row index sets of the partitions, empty if the partitions are contiguous ranges of the dataset
+    gsl::span<const gsl::index> TrainingRows() const { return trainingIndices; }
+    gsl::span<const gsl::index> TestRows() const { return testIndices; }
+
     const std::string& TargetVariable() const { return target; }
     const Grammar& GetGrammar() const { return grammar; }
     Grammar& GetGrammar() { return grammar; }
@@ -63,25 +76,32 @@ public:
 
     Solution CreateSolution(const Tree&) const;
 
+    // the scaling parameters of each input are kept by the dataset (see Dataset::GetScaling)
     void StandardizeData(Range range)
     {
-        for (const auto& var : inputVariables) {
-            dataset.Standardize(var.Index, range);
-        }
+        dataset.Standardize(InputIndices(), range);
     }
 
-    void NormalizeData(Range range) {
-        for (const auto& var : inputVariables) {
-            dataset.Normalize(var.Index, range);
-        }
+    void NormalizeData(Range range)
+    {
+        dataset.Normalize(InputIndices(), range);
     }
 
 private:
+    std::vector<gsl::index> InputIndices() const
+    {
+        std::vector<gsl::index> indices;
+        std::transform(inputVariables.begin(), inputVariables.end(), std::back_inserter(indices), [](const auto& v) { return v.Index; });
+        return indices;
+    }
+
     Dataset dataset;
     Grammar grammar;
     Range training;
     Range test;
     Range validation;
+    std::vector<gsl::index> trainingIndices;
+    std::vector<gsl::index> testIndices;
     std::string target;
     std::vector<Variable> inputVariables;
 };
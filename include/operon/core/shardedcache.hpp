@@ -0,0 +1,176 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+#ifndef SHARDED_CACHE_HPP
+#define SHARDED_CACHE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Operon {
+enum class CacheEviction {
+    FirstInFirstOut,
+    LeastRecentlyUsed
+};
+
+// every entry costs the same, the capacity is then a number of entries
+struct UnitWeigher {
+    template <typename T>
+    size_t operator()(const T&) const noexcept { return 1; }
+};
+
+// bounded concurrent key-value cache underlying the evaluation caches (see SubtreeCache and FitnessCache)
+// - the entries are distributed over independently locked shards by the hash of their key; each shard evicts its
+//   oldest (FirstInFirstOut) or least recently used (LeastRecentlyUsed) entries once their total cost, given by
+//   Weigher (eg. a size in bytes), exceeds its share of the capacity
+// - values are read under the lock of their shard (see Find), so readers copy out what they need
+template <typename Key, typename Value, typename KeyHash = std::hash<Key>, typename Weigher = UnitWeigher>
+class ShardedLruCache {
+public:
+    struct Statistics {
+        size_t Lookups;
+        size_t Hits;
+        size_t Insertions;
+        size_t Evictions;
+        size_t Entries;
+        size_t Cost;
+
+        double HitRate() const noexcept { return Lookups == 0 ? 0.0 : static_cast<double>(Hits) / Lookups; }
+    };
+
+    explicit ShardedLruCache(size_t capacity, CacheEviction eviction = CacheEviction::LeastRecentlyUsed)
+        : capacity(capacity)
+        , eviction(eviction)
+        , shards(Shards)
+    {
+    }
+
+    ShardedLruCache(const ShardedLruCache&) = delete;
+    ShardedLruCache& operator=(const ShardedLruCache&) = delete;
+
+    size_t Capacity() const noexcept { return capacity; }
+    CacheEviction EvictionPolicy() const noexcept { return eviction; }
+
+    // calls read with the cached value and returns true if the key is found
+    template <typename F>
+    bool Find(const Key& key, F&& read)
+    {
+        ++lookups;
+        auto& shard = GetShard(key);
+        std::lock_guard lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            return false;
+        }
+        ++hits;
+        if (eviction == CacheEviction::LeastRecentlyUsed) {
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        }
+        std::invoke(std::forward<F>(read), std::as_const(it->second->second));
+        return true;
+    }
+
+    // adds the value unless its key is already present (eg. inserted concurrently by another thread) or its cost
+    // exceeds the share of the capacity of a shard
+    void Insert(const Key& key, Value value)
+    {
+        auto cost = Weigher {}(value);
+        auto shardCapacity = std::max(capacity / Shards, size_t { 1 });
+        if (cost > shardCapacity) {
+            return;
+        }
+        auto& shard = GetShard(key);
+        std::lock_guard lock(shard.mutex);
+        if (shard.index.find(key) != shard.index.end()) {
+            return;
+        }
+        while (shard.cost + cost > shardCapacity) {
+            auto const& [k, v] = shard.entries.back();
+            auto c = Weigher {}(v);
+            shard.cost -= c;
+            totalCost -= c;
+            --entryCount;
+            ++evictions;
+            shard.index.erase(k);
+            shard.entries.pop_back();
+        }
+        shard.entries.emplace_front(key, std::move(value));
+        shard.index[key] = shard.entries.begin();
+        shard.cost += cost;
+        totalCost += cost;
+        ++entryCount;
+        ++insertions;
+    }
+
+    void Clear()
+    {
+        for (auto& shard : shards) {
+            std::lock_guard lock(shard.mutex);
+            shard.entries.clear();
+            shard.index.clear();
+            shard.cost = 0;
+        }
+        entryCount = 0;
+        totalCost = 0;
+    }
+
+    Statistics GetStatistics() const noexcept
+    {
+        return Statistics { lookups, hits, insertions, evictions, entryCount, totalCost };
+    }
+
+    void ResetStatistics() noexcept
+    {
+        lookups = 0;
+        hits = 0;
+        insertions = 0;
+        evictions = 0;
+    }
+
+private:
+    struct Shard {
+        std::mutex mutex;
+        std::list<std::pair<Key, Value>> entries; // most recently inserted (or used) first
+        std::unordered_map<Key, typename decltype(entries)::iterator, KeyHash> index;
+        size_t cost = 0;
+    };
+
+    static constexpr size_t Shards = 64;
+
+    Shard& GetShard(const Key& key) noexcept { return shards[(KeyHash {}(key) >> 32) % Shards]; }
+
+    size_t capacity;
+    CacheEviction eviction;
+    std::vector<Shard> shards;
+
+    std::atomic_size_t lookups = 0;
+    std::atomic_size_t hits = 0;
+    std::atomic_size_t insertions = 0;
+    std::atomic_size_t evictions = 0;
+    std::atomic_size_t entryCount = 0;
+    std::atomic_size_t totalCost = 0;
+};
+} // namespace Operon
+
+#endif
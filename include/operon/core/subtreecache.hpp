@@ -0,0 +1,104 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+#ifndef SUBTREE_CACHE_HPP
+#define SUBTREE_CACHE_HPP
+
+#include <atomic>
+#include <memory>
+
+#include "core/common.hpp"
+#include "core/shardedcache.hpp"
+
+namespace Operon {
+// bounded concurrent cache of subtree evaluation results, keyed by the strict subtree hash (see
+// EvaluationPlan::SubtreeHashes) and the evaluated range, such that building blocks shared by many individuals
+// (eg. after subtree crossover) are computed once and then read back by the interpreter
+// - the capacity is in bytes of cached values, the least recently used entries are evicted (see ShardedLruCache)
+// - a subtree is only admitted once it was looked up a second time (a first lookup only records its hash in a
+//   small direct-mapped table), so that the many subtrees which occur in a single individual are not copied out
+// - entries are handed out as shared pointers, so an entry evicted by another thread stays valid for its readers
+// - the subtree hashes include the dataset version, so entries computed before the values were modified (eg. by
+//   Standardize) are no longer found and are eventually evicted
+class SubtreeCache {
+public:
+    using ValueType = Operon::Vector<Operon::Scalar>;
+
+    static constexpr size_t DefaultCapacity = 256UL << 20; // bytes
+    static constexpr size_t DefaultMinLength = 8; // descendants, smaller subtrees are about as fast to evaluate as to read back
+
+    struct Statistics {
+        size_t Lookups;
+        size_t Hits;
+        size_t Insertions;
+        size_t Evictions;
+        size_t Entries;
+        size_t Bytes;
+
+        double HitRate() const noexcept { return Lookups == 0 ? 0.0 : static_cast<double>(Hits) / Lookups; }
+    };
+
+    // capacity in bytes; only subtrees with at least minLength descendants are cached
+    explicit SubtreeCache(size_t capacity = DefaultCapacity, size_t minLength = DefaultMinLength);
+
+    SubtreeCache(const SubtreeCache&) = delete;
+    SubtreeCache& operator=(const SubtreeCache&) = delete;
+
+    size_t Capacity() const noexcept { return cache.Capacity(); }
+    size_t MinLength() const noexcept { return minLength; }
+
+    // returns the cached values of the subtree over the range, or nullptr
+    std::shared_ptr<const ValueType> Find(Operon::Hash hash, Range range);
+
+    // true if the subtree missed before, ie. it is shared by several evaluations and should be inserted
+    bool Admit(Operon::Hash hash, Range range) noexcept;
+
+    // adds the values of the subtree over the range (values.size() == range.Size())
+    void Insert(Operon::Hash hash, Range range, std::shared_ptr<const ValueType> values);
+
+    void Clear();
+
+    Statistics GetStatistics() const noexcept;
+    void ResetStatistics() noexcept;
+
+private:
+    struct Key {
+        Operon::Hash Hash;
+        size_t Start;
+        size_t Size;
+
+        bool operator==(const Key& rhs) const noexcept { return Hash == rhs.Hash && Start == rhs.Start && Size == rhs.Size; }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const noexcept { return key.Hash ^ (key.Start * 0x9e3779b97f4a7c15ULL) ^ key.Size; }
+    };
+
+    struct ByteWeigher {
+        size_t operator()(const std::shared_ptr<const ValueType>& values) const noexcept { return values->size() * sizeof(Operon::Scalar); }
+    };
+
+    static constexpr size_t AdmissionSlots = 1UL << 16;
+
+    size_t minLength;
+    ShardedLruCache<Key, std::shared_ptr<const ValueType>, KeyHash, ByteWeigher> cache;
+    std::unique_ptr<std::atomic<Operon::Hash>[]> admission; // hashes of recently missed subtrees
+};
+} // namespace Operon
+
+#endif
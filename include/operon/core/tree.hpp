@@ -120,9 +120,15 @@ public:
     {
     }
 
-    Tree& operator=(Tree rhs)
+    // copying into an existing tree reuses its storage when it is large enough
+    Tree& operator=(const Tree& rhs)
     {
-        swap(rhs);
+        nodes = rhs.nodes;
+        return *this;
+    }
+    Tree& operator=(Tree&& rhs) noexcept
+    {
+        nodes = std::move(rhs.nodes);
         return *this;
     }
 
@@ -134,6 +140,10 @@ public:
     Tree& UpdateNodes();
     Tree& UpdateNodeDepth();
     Tree& Sort(Operon::HashMode);
+    // sorts node i and its ancestors only, updating their hash values: the rest of the tree must be sorted in
+    // the same mode already, eg. when node i is the only one that changed since (the root of a subtree inserted
+    // by crossover, or a mutated node) and the parent indices are up to date
+    Tree& Sort(gsl::index i, Operon::HashMode);
     Tree& Reduce();
     Tree& Simplify();
 
@@ -50,7 +50,8 @@ public:
         assert(targetLen > 0);
 
         auto [minFunctionArity, maxFunctionArity] = grammar.FunctionArityLimits();
-        if (minFunctionArity > 1 && targetLen % 2 == 0) {
+        // binary functions only make trees of odd length
+        if (minFunctionArity == 2 && maxFunctionArity == 2 && targetLen % 2 == 0) {
             targetLen = std::bernoulli_distribution(0.5)(random) ? targetLen - 1 : targetLen + 1;
         }
 
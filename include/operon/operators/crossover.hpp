@@ -34,20 +34,29 @@ public:
     {
     }
     auto operator()(Operon::Random& random, const Tree& lhs, const Tree& rhs) const -> Tree override;
+    void operator()(Operon::Random& random, const Tree& lhs, const Tree& rhs, Tree& child) const override;
     std::pair<gsl::index, gsl::index> FindCompatibleSwapLocations(Operon::Random& random, const Tree& lhs, const Tree& rhs) const;
 
     static inline Tree Cross(const Tree& lhs, const Tree& rhs, gsl::index i, gsl::index j) 
+    {
+        Tree child;
+        Cross(lhs, rhs, i, j, child);
+        return child;
+    }
+
+    // replaces the subtree i of lhs with the subtree j of rhs, writing the result into child (which must not be
+    // one of the parents) without allocating if its storage is large enough
+    static inline void Cross(const Tree& lhs, const Tree& rhs, gsl::index i, gsl::index j, Tree& child)
     {
         auto& left = lhs.Nodes();
         auto& right = rhs.Nodes();
-        std::vector<Node> nodes;
+        auto& nodes = child.Nodes();
+        nodes.clear();
         nodes.reserve(right[j].Length - left[i].Length + left.size());
         copy_n(left.begin(), i - left[i].Length, back_inserter(nodes));
         copy_n(right.begin() + j - right[j].Length, right[j].Length + 1, back_inserter(nodes));
         copy_n(left.begin() + i + 1, left.size() - (i + 1), back_inserter(nodes));
-
-        auto child = Tree(nodes).UpdateNodes();
-        return child;
+        child.UpdateNodes();
     }
 
 private:
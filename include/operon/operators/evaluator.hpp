@@ -21,12 +21,137 @@
 #define EVALUATOR_HPP
 
 #include "core/eval.hpp"
+#include "core/levenbergmarquardt.hpp"
 #include "core/metrics.hpp"
 #include "core/operator.hpp"
 #include "stat/meanvariance.hpp"
 #include "stat/pearson.hpp"
 
 namespace Operon {
+namespace detail {
+    // optimizes the coefficients with the given method and returns the number of iterations performed
+    // (ceres evaluates the residuals with the native code of the plan, if one is given)
+    inline size_t OptimizeCoefficients(LocalOptimizer method, Tree& tree, EvaluationPlan& plan, const gsl::span<const Operon::Scalar> targetValues, const Range range, size_t iterations, const NativePlan* native = nullptr)
+    {
+        if (method == LocalOptimizer::Ceres) {
+            return OptimizeReverse(tree, plan, targetValues, range, iterations, true, false, native).iterations.size();
+        }
+        return OptimizeLevenbergMarquardt(tree, plan, targetValues, range, iterations).Iterations;
+    }
+
+    inline size_t OptimizeCoefficients(LocalOptimizer method, Tree& tree, EvaluationPlan& plan, const gsl::span<const Operon::Scalar> targetValues, gsl::span<const gsl::index> rows, size_t iterations)
+    {
+        if (method == LocalOptimizer::Ceres) {
+            return OptimizeReverse(tree, plan, targetValues, rows, iterations).iterations.size();
+        }
+        return OptimizeLevenbergMarquardt(tree, plan, targetValues, rows, iterations).Iterations;
+    }
+
+    // target values of the training partition, gathered into a thread-local buffer when it is an index set
+    inline gsl::span<const Operon::Scalar> TrainingTargets(const Problem& problem)
+    {
+        auto targetValues = problem.TargetValues();
+        auto rows = problem.TrainingRows();
+        if (rows.empty()) {
+            auto range = problem.TrainingRange();
+            return targetValues.subspan(range.Start(), range.Size());
+        }
+        thread_local Operon::Vector<Operon::Scalar> gathered;
+        gathered.resize(rows.size());
+        std::transform(rows.begin(), rows.end(), gathered.begin(), [&](auto i) { return targetValues[i]; });
+        return gathered;
+    }
+
+    // native code of the workspace plan
+    inline NativePlan& NativeCode()
+    {
+        thread_local NativePlan native;
+        return native;
+    }
+
+    // evaluates the compiled tree on the training partition: incrementally from the retained parent sharing the most
+    // nodes with it (subtrees with unchanged coefficients, see NodeValues::SharedSubtrees) if they make up at least
+    // half of the tree, else with the native code generated for the plan by CompileAndOptimize if there is any, else
+    // using the subtree cache if one is given
+    // returns true if the evaluation was incremental
+    inline bool EvaluateTraining(const EvaluationPlan& plan, const Tree& tree, const Problem& problem, gsl::span<Operon::Scalar> result, SubtreeCache* cache, gsl::span<const NodeValues> retained)
+    {
+        const NodeValues* parent = nullptr;
+        size_t shared = 0;
+        for (auto const& values : retained) {
+            if (auto n = values.SharedSubtrees(tree); n > shared) {
+                shared = n;
+                parent = &values;
+            }
+        }
+
+        if (auto rows = problem.TrainingRows(); !rows.empty()) {
+            Evaluate<Operon::Scalar>(plan, rows, nullptr, result);
+        } else if (parent != nullptr && 2 * shared >= tree.Length()) {
+            return EvaluateIncremental(plan, tree, *parent, result) > 0;
+        } else if (NativeCode().Plan() == &plan) {
+            NativeCode().Evaluate(problem.TrainingRange(), nullptr, result);
+        } else if (cache != nullptr) {
+            Evaluate(plan, problem.TrainingRange(), result, *cache);
+        } else {
+            Evaluate<Operon::Scalar>(plan, problem.TrainingRange(), nullptr, result);
+        }
+        return false;
+    }
+
+    // plan used for evaluations on a row sample (kept apart from the workspace plan which targets the whole dataset)
+    inline EvaluationPlan& SamplePlan()
+    {
+        thread_local EvaluationPlan plan;
+        return plan;
+    }
+
+    // evaluates the tree on all the rows of the sample, returning a view of the workspace estimated values
+    inline gsl::span<Operon::Scalar> EvaluateSample(const Tree& tree, const Dataset& sample)
+    {
+        auto& plan = SamplePlan();
+        plan.Compile(tree, sample);
+        auto estimatedValues = EvaluationWorkspace<Operon::Scalar>::Local().Estimated(sample.Rows());
+        Evaluate<Operon::Scalar>(plan, Range { 0, sample.Rows() }, nullptr, estimatedValues);
+        return estimatedValues;
+    }
+
+    // compiles the tree against the problem's dataset, optimizing its coefficients first if iterations > 0
+    // when a sample is given the coefficients are optimized on the sampled rows only (using a separate plan)
+    // native code is generated for the plan only if it is then evaluated many times: when the tree is at least
+    // jitThreshold nodes long (0 disables it) and its coefficients are optimized with ceres on the training range
+    // (the residual evaluations and the final evaluation share the code, see NativeCode)
+    // returns the number of local optimization iterations performed
+    inline size_t CompileAndOptimize(LocalOptimizer method, Tree& tree, EvaluationPlan& plan, const Problem& problem, const Dataset* sample, size_t iterations, size_t jitThreshold = 0)
+    {
+        auto const& dataset = problem.GetDataset();
+        NativeCode().Clear();
+        if (iterations == 0) {
+            plan.Compile(tree, dataset);
+            return 0;
+        }
+
+        if (sample == nullptr) {
+            auto targetValues = TrainingTargets(problem);
+            plan.Compile(tree, dataset);
+            if (auto rows = problem.TrainingRows(); !rows.empty()) {
+                return OptimizeCoefficients(method, tree, plan, targetValues, rows, iterations);
+            }
+            if (method == LocalOptimizer::Ceres && jitThreshold > 0 && tree.Length() >= jitThreshold && NativeCode().Compile(plan)) {
+                return OptimizeCoefficients(method, tree, plan, targetValues, problem.TrainingRange(), iterations, &NativeCode());
+            }
+            return OptimizeCoefficients(method, tree, plan, targetValues, problem.TrainingRange(), iterations);
+        }
+
+        auto& samplePlan = SamplePlan();
+        samplePlan.Compile(tree, *sample);
+        auto sampleRange = Range { 0, sample->Rows() };
+        auto n = OptimizeCoefficients(method, tree, samplePlan, sample->GetValues(problem.TargetVariable()), sampleRange, iterations);
+        plan.Compile(tree, dataset); // picks up the optimized coefficients from the tree
+        return n;
+    }
+} // namespace detail
+
 template <typename T>
 class NormalizedMeanSquaredErrorEvaluator : public EvaluatorBase<T> {
 public:
@@ -36,26 +161,75 @@ public:
     }
 
     typename NormalizedMeanSquaredErrorEvaluator::ReturnType
-    operator()(Operon::Random&, T& ind) const override
+    operator()(Operon::Random& random, T& ind) const override
+    {
+        return (*this)(random, ind, Operon::Numeric::Max<Operon::Scalar>());
+    }
+
+    typename NormalizedMeanSquaredErrorEvaluator::ReturnType
+    operator()(Operon::Random&, T& ind, Operon::Scalar threshold) const override
     {
+        this->Simplify(ind);
+        Operon::Hash key {};
+        if (auto fitness = this->Recall(ind, key); fitness.has_value()) {
+            return fitness.value();
+        }
         ++this->fitnessEvaluations;
         auto& problem = this->problem.get();
-        auto& dataset = problem.GetDataset();
         auto& genotype = ind.Genotype;
 
-        auto trainingRange = problem.TrainingRange();
-        auto targetValues = dataset.GetValues(problem.TargetVariable()).subspan(trainingRange.Start(), trainingRange.Size());
-
-        if (this->iterations > 0) {
-            auto summary = OptimizeAutodiff(genotype, dataset, targetValues, trainingRange, this->iterations);
-            this->localEvaluations += summary.iterations.size();
+        // racing: reject the candidate if the lower confidence bound of its nmse on the sample exceeds the threshold
+        // the race comes before local optimization, so a rejected candidate costs only its evaluation on the sample;
+        // as its coefficients are then still the ones inherited from the parents, with local optimization enabled
+        // the estimated values are first scaled to the sample targets by linear least squares
+        if (auto racingSample = this->RacingSample(); racingSample != nullptr && threshold < Operon::Numeric::Max<Operon::Scalar>() && this->racingTargetVariance > 0) {
+            auto sampleEstimated = detail::EvaluateSample(genotype, *racingSample);
+            auto sampleTargets = racingSample->GetValues(problem.TargetVariable());
+            Operon::Scalar intercept = 0;
+            Operon::Scalar slope = 1;
+            if (this->iterations > 0) {
+                PearsonsRCalculator calc;
+                for (size_t i = 0; i < sampleEstimated.size(); ++i) {
+                    calc.Add(sampleEstimated[i], sampleTargets[i]);
+                }
+                auto variance = calc.NaiveVarianceX();
+                slope = variance > 0 ? calc.NaiveCovariance() / variance : 0;
+                intercept = calc.MeanY() - slope * calc.MeanX();
+            }
+            MeanVarianceCalculator errcalc;
+            for (size_t i = 0; i < sampleEstimated.size(); ++i) {
+                auto e = intercept + slope * sampleEstimated[i] - sampleTargets[i];
+                errcalc.Add(e * e);
+            }
+            auto mean = errcalc.Mean();
+            if (!std::isfinite(mean)) {
+                ++this->racingRejections;
+                return Operon::Numeric::Max<Operon::Scalar>();
+            }
+            auto stderror = std::sqrt(errcalc.SampleVariance() / sampleEstimated.size());
+            if ((mean - this->racingConfidence * stderror) / this->racingTargetVariance > threshold) {
+                ++this->racingRejections;
+                return mean / this->racingTargetVariance;
+            }
         }
 
-        auto estimatedValues = Evaluate<Operon::Scalar>(genotype, dataset, trainingRange);
+        // compile the tree once and reuse it for both local optimization and fitness calculation
+        // (the plan and the estimated values live in the thread's workspace to avoid heap allocations)
+        auto& workspace = EvaluationWorkspace<Operon::Scalar>::Local();
+        auto& plan = workspace.Plan();
+        this->localEvaluations += detail::CompileAndOptimize(this->optimizer, genotype, plan, problem, this->LocalOptimizationSample(), this->iterations, this->jitThreshold);
+
+        auto estimatedValues = workspace.Estimated(problem.TrainingRange().Size());
+        if (detail::EvaluateTraining(plan, genotype, problem, estimatedValues, this->cache, this->retained)) {
+            ++this->incrementalEvaluations;
+        }
+        auto targetValues = detail::TrainingTargets(problem);
         auto nmse = NormalizedMeanSquaredError(estimatedValues, targetValues);
         if (!std::isfinite(nmse)) {
             nmse = Operon::Numeric::Max<Operon::Scalar>();
         }
+        this->Remember(key, ind, nmse);
+        this->Resort(ind);
         return nmse;
     }
 
@@ -77,28 +251,66 @@ public:
     }
 
     typename RSquaredEvaluator::ReturnType
-    operator()(Operon::Random&, T& ind) const
+    operator()(Operon::Random& random, T& ind) const override
+    {
+        return (*this)(random, ind, Operon::Numeric::Max<Operon::Scalar>());
+    }
+
+    typename RSquaredEvaluator::ReturnType
+    operator()(Operon::Random&, T& ind, Operon::Scalar threshold) const override
     {
+        this->Simplify(ind);
+        Operon::Hash key {};
+        if (auto fitness = this->Recall(ind, key); fitness.has_value()) {
+            return fitness.value();
+        }
         ++this->fitnessEvaluations;
         auto& problem = this->problem.get();
-        auto& dataset = problem.GetDataset();
         auto& genotype = ind.Genotype;
 
-        auto trainingRange = problem.TrainingRange();
-        auto targetValues = dataset.GetValues(problem.TargetVariable()).subspan(trainingRange.Start(), trainingRange.Size());
-
-        if (this->iterations > 0) {
-            auto summary = OptimizeAutodiff(genotype, dataset, targetValues, trainingRange, this->iterations);
-            this->localEvaluations += summary.iterations.size();
+        // racing: reject the candidate if the fitness corresponding to the upper confidence bound of r^2 on the
+        // sample exceeds the threshold (the interval for the correlation coefficient uses the Fisher transformation)
+        // the race comes before local optimization, so a rejected candidate costs only its evaluation on the sample
+        if (auto racingSample = this->RacingSample(); racingSample != nullptr && threshold < Operon::Numeric::Max<Operon::Scalar>() && racingSample->Rows() > 3) {
+            auto sampleEstimated = detail::EvaluateSample(genotype, *racingSample);
+            auto sampleTargets = racingSample->GetValues(problem.TargetVariable());
+            auto r = PearsonsRCalculator::Coefficient(sampleEstimated, sampleTargets);
+            if (!std::isfinite(r)) {
+                ++this->racingRejections;
+                return UpperBound;
+            }
+            constexpr Operon::Scalar rmax = 1 - 1e-12; // keep atanh finite
+            auto z = std::atanh(std::clamp(r, -rmax, rmax));
+            auto w = this->racingConfidence / std::sqrt(static_cast<Operon::Scalar>(racingSample->Rows() - 3));
+            auto lo = std::tanh(z - w);
+            auto hi = std::tanh(z + w);
+            auto r2max = std::max(lo * lo, hi * hi);
+            if (UpperBound - r2max + LowerBound > threshold) {
+                ++this->racingRejections;
+                return UpperBound - r * r + LowerBound;
+            }
         }
 
-        auto estimatedValues = Evaluate<Operon::Scalar>(genotype, dataset, trainingRange);
+        // compile the tree once and reuse it for both local optimization and fitness calculation
+        // (the plan and the estimated values live in the thread's workspace to avoid heap allocations)
+        auto& workspace = EvaluationWorkspace<Operon::Scalar>::Local();
+        auto& plan = workspace.Plan();
+        this->localEvaluations += detail::CompileAndOptimize(this->optimizer, genotype, plan, problem, this->LocalOptimizationSample(), this->iterations, this->jitThreshold);
+
+        auto estimatedValues = workspace.Estimated(problem.TrainingRange().Size());
+        if (detail::EvaluateTraining(plan, genotype, problem, estimatedValues, this->cache, this->retained)) {
+            ++this->incrementalEvaluations;
+        }
+        auto targetValues = detail::TrainingTargets(problem);
         auto r2 = RSquared(estimatedValues, targetValues);
         if (!std::isfinite(r2)) {
             r2 = 0;
         }
         std::clamp(r2, LowerBound, UpperBound);
-        return UpperBound - r2 + LowerBound;
+        auto fitness = UpperBound - r2 + LowerBound;
+        this->Remember(key, ind, fitness);
+        this->Resort(ind);
+        return fitness;
     }
 
     void Prepare(const gsl::span<const T> pop)
@@ -36,6 +36,16 @@ public:
     using U = typename TMaleSelector::SelectableType;
     constexpr static int Idx = TFemaleSelector::SelectableIndex;
     std::optional<T> operator()(Operon::Random& random, double pCrossover, double pMutation) const override
+    {
+        T child;
+        if (Generate(random, pCrossover, pMutation, child)) {
+            return std::make_optional(std::move(child));
+        }
+        return std::nullopt;
+    }
+
+    // the genotype is built in the child's storage: crossover writes into it and mutation moves it in and out
+    bool Generate(Operon::Random& random, double pCrossover, double pMutation, T& child) const override
     {
         static_assert(std::is_same_v<T, U>);
         std::uniform_real_distribution<double> uniformReal;
@@ -43,28 +53,28 @@ public:
         bool doMutation = std::bernoulli_distribution(pMutation)(random);
 
         if (!(doCrossover || doMutation))
-            return std::nullopt;
+            return false;
 
         auto population = this->FemaleSelector().Population();
 
         auto first = this->femaleSelector(random);
-        T child;
 
         if (doCrossover) {
             auto second = this->maleSelector(random);
-            child.Genotype = this->crossover(random, population[first].Genotype, population[second].Genotype);
+            this->crossover(random, population[first].Genotype, population[second].Genotype, child.Genotype);
         }
 
         if (doMutation) {
-            child.Genotype = doCrossover
-                ? this->mutator(random, std::move(child.Genotype))
-                : this->mutator(random, population[first].Genotype);
+            if (!doCrossover) {
+                child.Genotype = population[first].Genotype;
+            }
+            child.Genotype = this->mutator(random, std::move(child.Genotype));
         }
 
         auto f = this->evaluator(random, child);
         if (!std::isfinite(f)) { f = Operon::Numeric::Max<Operon::Scalar>(); }
         child[Idx] = f;
-        return std::make_optional(child);
+        return true;
     }
 };
 
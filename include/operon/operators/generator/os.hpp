@@ -33,13 +33,23 @@ public:
 
     using T = typename TFemaleSelector::SelectableType;
     std::optional<T> operator()(Operon::Random& random, double pCrossover, double pMutation) const override
+    {
+        T child;
+        if (Generate(random, pCrossover, pMutation, child)) {
+            return std::make_optional(std::move(child));
+        }
+        return std::nullopt;
+    }
+
+    // the genotype is built in the child's storage, which is left in an unspecified state if the offspring is rejected
+    bool Generate(Operon::Random& random, double pCrossover, double pMutation, T& child) const override
     {
         std::uniform_real_distribution<double> uniformReal;
         bool doCrossover = uniformReal(random) < pCrossover;
         bool doMutation = uniformReal(random) < pMutation;
 
         if (!(doCrossover || doMutation))
-            return std::nullopt;
+            return false;
 
         constexpr gsl::index Idx = TFemaleSelector::SelectableIndex;
         auto population = this->FemaleSelector().Population();
@@ -47,28 +57,28 @@ public:
         auto first = this->femaleSelector(random);
         auto fit = population[first][Idx];
 
-        typename TFemaleSelector::SelectableType child;
-
         if (doCrossover) {
             auto second = this->maleSelector(random);
-            child.Genotype = this->crossover(random, population[first].Genotype, population[second].Genotype);
+            this->crossover(random, population[first].Genotype, population[second].Genotype, child.Genotype);
 
             fit = std::min(fit, population[second][Idx]);
         }
 
         if (doMutation) {
-            child.Genotype = doCrossover
-                ? this->mutator(random, std::move(child.Genotype))
-                : this->mutator(random, population[first].Genotype);
+            if (!doCrossover) {
+                child.Genotype = population[first].Genotype;
+            }
+            child.Genotype = this->mutator(random, std::move(child.Genotype));
         }
 
-        auto f = this->evaluator(random, child);
+        // the parent fitness is passed as a threshold so that hopeless offspring can be rejected early
+        auto f = this->evaluator(random, child, fit);
 
         if (std::isfinite(f) && f < fit) {
-            child[Idx] = this->evaluator(random, child);
-            return std::make_optional(child);
+            child[Idx] = f;
+            return true;
         }
-        return std::nullopt;
+        return false;
     }
 
     void MaxSelectionPressure(size_t value) { maxSelectionPressure = value; }
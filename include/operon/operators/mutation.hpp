@@ -31,6 +31,7 @@ struct MultiPointMutation : public MutatorBase {
     Tree operator()(Operon::Random&, Tree) const override;
 };
 
+// the hashes are maintained (or not) by each of the mutation operators added to it
 struct MultiMutation : public MutatorBase {
     Tree operator()(Operon::Random&, Tree) const override;
 
@@ -35,8 +35,10 @@ class KeepBestReinserter : public ReinserterBase<T, Idx> {
             std::sort(ep, pool.begin(), pool.end(), comp);
 
             for (size_t i = 0, j = 0; i < pool.size() && j < pop.size();) {
-                if (pop[j][Idx] > pool[i][Idx]) {
-                    pop[j++] = std::move(pool[i]);
+                // empty genotypes are pool individuals for which no offspring was produced
+                if (!pool[i].Genotype.Empty() && pop[j][Idx] > pool[i][Idx]) {
+                    // swapping keeps the storage of the replaced individual for the next recombination pool
+                    std::swap(pop[j++], pool[i]);
                 }
                 ++i;
             }
@@ -36,7 +36,14 @@ class ReplaceWorstReinserter : public ReinserterBase<T, Idx> {
                 std::sort(ep, pool.begin(), pool.end(), comp);
             }
             auto offset = std::min(pop.size(), pool.size());
-            std::copy_if(ep, std::make_move_iterator(pool.begin()), std::make_move_iterator(pool.begin() + offset), pop.begin() + pop.size() - offset, [](const auto& ind) { return !ind.Genotype.Empty(); });
+            // swapping keeps the storage of the replaced individuals for the next recombination pool
+            auto out = pop.begin() + pop.size() - offset;
+            for (auto it = pool.begin(); it != pool.begin() + offset; ++it) {
+                // empty genotypes are pool individuals for which no offspring was produced
+                if (!it->Genotype.Empty()) {
+                    std::swap(*out++, *it);
+                }
+            }
         }
 };
 } // namespace operon
@@ -107,6 +107,7 @@ PYBIND11_MODULE(example, m) {
         .def("GetFrequency", &Operon::Grammar::GetFrequency)
         .def("EnabledSymbols", &Operon::Grammar::EnabledSymbols)
         .def("FunctionArityLimits", &Operon::Grammar::FunctionArityLimits)
+        .def_property("MaximumArity", py::overload_cast<>(&Operon::Grammar::MaximumArity, py::const_), py::overload_cast<size_t>(&Operon::Grammar::MaximumArity))
         .def("SampleRandomSymbol", &Operon::Grammar::SampleRandomSymbol)
         ;
 
@@ -0,0 +1,58 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#include <cstdlib>
+
+#include <cxxopts.hpp>
+#include <fmt/core.h>
+
+#include "core/dataset.hpp"
+
+using namespace Operon;
+
+// converts a csv dataset into the binary columnar format, which operon-gp can memory-map directly
+int main(int argc, char* argv[])
+{
+    cxxopts::Options opts("operon_convert", "Convert a csv dataset into the operon binary format");
+
+    opts.add_options()
+        ("input", "Input csv file", cxxopts::value<std::string>())
+        ("output", "Output binary file", cxxopts::value<std::string>())
+        ("no-header", "The csv file does not have a header", cxxopts::value<bool>()->default_value("false"))
+        ("help", "Print help");
+
+    auto result = opts.parse(argc, argv);
+    if (result.count("help") > 0 || result.count("input") == 0 || result.count("output") == 0) {
+        fmt::print("{}\n", opts.help());
+        exit(result.count("help") > 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    try {
+        auto input = result["input"].as<std::string>();
+        auto output = result["output"].as<std::string>();
+        Dataset dataset(input, !result["no-header"].as<bool>());
+        dataset.Save(output);
+        fmt::print("{}: {} rows, {} columns -> {}\n", input, dataset.Rows(), dataset.Cols(), output);
+    } catch (std::exception& e) {
+        fmt::print(stderr, "{}\n", e.what());
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
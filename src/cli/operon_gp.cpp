@@ -25,6 +25,7 @@
 #include <tbb/task_scheduler_init.h>
 
 #include "algorithms/gp.hpp"
+#include "analyzers/diversity.hpp"
 
 #include "core/common.hpp"
 #include "core/format.hpp"
@@ -48,7 +49,7 @@ int main(int argc, char* argv[])
     cxxopts::Options opts("operon_cli", "C++ large-scale genetic programming");
 
     opts.add_options()
-        ("dataset", "Dataset file name (csv) (required)", cxxopts::value<std::string>())
+        ("dataset", "Dataset file name (csv or binary, see operon-convert) (required)", cxxopts::value<std::string>())
         ("shuffle", "Shuffle the input data", cxxopts::value<bool>()->default_value("false"))
         ("standardize", "Standardize the training partition (zero mean, unit variance)", cxxopts::value<bool>()->default_value("false"))
         ("train", "Training range specified as start:end (required)", cxxopts::value<std::string>())
@@ -60,6 +61,17 @@ int main(int argc, char* argv[])
         ("generations", "Number of generations", cxxopts::value<size_t>()->default_value("1000"))
         ("evaluations", "Evaluation budget", cxxopts::value<size_t>()->default_value("1000000"))
         ("iterations", "Local optimization iterations", cxxopts::value<size_t>()->default_value("50"))
+        ("local-optimizer", "Local optimization method (ceres, lm)", cxxopts::value<std::string>()->default_value("ceres"))
+        ("local-sample-size", "Number of training rows used for local optimization, resampled every generation (0 = all rows)", cxxopts::value<size_t>()->default_value("0"))
+        ("local-sampling", "Sampling of the local optimization rows (random, stratified)", cxxopts::value<std::string>()->default_value("random"))
+        ("racing-sample-size", "Number of training rows used to reject offspring early under offspring selection (0 = disabled)", cxxopts::value<size_t>()->default_value("0"))
+        ("racing-confidence", "Half-width of the racing confidence interval in standard errors", cxxopts::value<Operon::Scalar>()->default_value("3"))
+        ("subtree-cache", "Memory for caching the values of subtrees shared between individuals, in MiB (0 = disabled)", cxxopts::value<size_t>()->default_value("0"))
+        ("fitness-cache", "Number of fitness values of evaluated trees kept to skip the evaluation of duplicate offspring (0 = disabled)", cxxopts::value<size_t>()->default_value("0"))
+        ("retain-parents", "Number of best parents whose node values are kept to evaluate their offspring incrementally (0 = disabled, mostly ineffective with local optimization)", cxxopts::value<size_t>()->default_value("0"))
+        ("jit-threshold", "Minimum length of the trees evaluated with native code generated at runtime during local optimization with ceres (0 = disabled)", cxxopts::value<size_t>()->default_value("0"))
+        ("simplify", "Simplify the offspring before evaluating them", cxxopts::value<bool>()->default_value("false"))
+        ("maintain-hashes", "Keep the genotypes sorted by updating their hashes incrementally during crossover and mutation, instead of sorting them for the fitness cache and the diversity", cxxopts::value<bool>()->default_value("false"))
         ("selection-pressure", "Selection pressure", cxxopts::value<size_t>()->default_value("100"))
         ("maxlength", "Maximum length", cxxopts::value<size_t>()->default_value("50"))
         ("maxdepth", "Maximum depth", cxxopts::value<size_t>()->default_value("10"))
@@ -71,7 +83,9 @@ int main(int argc, char* argv[])
         ("reinserter", "Reinsertion operator merging offspring in the recombination pool back into the population", cxxopts::value<std::string>())
         ("enable-symbols", "Comma-separated list of enabled symbols (add, sub, mul, div, exp, log, sin, cos, tan, sqrt, cbrt)", cxxopts::value<std::string>())
         ("disable-symbols", "Comma-separated list of disabled symbols (add, sub, mul, div, exp, log, sin, cos, tan, sqrt, cbrt)", cxxopts::value<std::string>())
+        ("max-arity", "Maximum arity of the additions and multiplications created at initialization", cxxopts::value<size_t>()->default_value("2"))
         ("show-grammar", "Show grammar (primitive set) used by the algorithm")
+        ("calibrate-batch-size", "Calibrate the interpreter batch size on the training data before running")
         ("threads", "Number of threads to use for parallelism", cxxopts::value<size_t>()->default_value("0"))
         ("debug", "Debug mode (more information displayed)")("help", "Print help");
 
@@ -195,6 +209,7 @@ int main(int argc, char* argv[])
         auto variables = dataset->Variables();
         auto problem = Problem(*dataset, variables, target, trainingRange, testRange);
         problem.GetGrammar().SetConfig(grammarConfig);
+        problem.GetGrammar().MaximumArity(std::max(result["max-arity"].as<size_t>(), size_t { 2 }));
         auto inputs = problem.InputVariables();
 
         const gsl::index idx { 0 };
@@ -215,9 +230,50 @@ int main(int argc, char* argv[])
         mutator.Add(changeVar, 1.0);
         mutator.Add(changeFunc, 1.0);
 
+        auto maintainHashes = result["maintain-hashes"].as<bool>();
+        if (maintainHashes) {
+            crossover.MaintainHashes(HashMode::Strict);
+            for (auto* m : std::initializer_list<MutatorBase*> { &mutator, &onePoint, &changeVar, &changeFunc }) {
+                m->MaintainHashes(HashMode::Strict);
+            }
+        }
+
         Evaluator evaluator(problem);
         evaluator.LocalOptimizationIterations(config.Iterations);
         evaluator.Budget(config.Evaluations);
+        if (auto method = result["local-optimizer"].as<std::string>(); method == "ceres") {
+            evaluator.LocalOptimizationMethod(LocalOptimizer::Ceres);
+        } else if (method == "lm") {
+            evaluator.LocalOptimizationMethod(LocalOptimizer::LevenbergMarquardt);
+        } else {
+            fmt::print(stderr, "{}\n{}\n", "Error: unknown local optimizer.", opts.help());
+            exit(EXIT_FAILURE);
+        }
+        evaluator.LocalOptimizationSampleSize(result["local-sample-size"].as<size_t>());
+        if (auto sampling = result["local-sampling"].as<std::string>(); sampling == "random") {
+            evaluator.LocalOptimizationSampling(RowSampling::Random);
+        } else if (sampling == "stratified") {
+            evaluator.LocalOptimizationSampling(RowSampling::Stratified);
+        } else {
+            fmt::print(stderr, "{}\n{}\n", "Error: unknown local sampling method.", opts.help());
+            exit(EXIT_FAILURE);
+        }
+        evaluator.RacingSampleSize(result["racing-sample-size"].as<size_t>());
+        evaluator.RacingConfidence(result["racing-confidence"].as<Operon::Scalar>());
+        std::unique_ptr<SubtreeCache> cache;
+        if (auto mib = result["subtree-cache"].as<size_t>(); mib > 0) {
+            cache = std::make_unique<SubtreeCache>(mib << 20);
+            evaluator.Cache(cache.get());
+        }
+        std::unique_ptr<FitnessCache> fitnessCache;
+        if (auto entries = result["fitness-cache"].as<size_t>(); entries > 0) {
+            fitnessCache = std::make_unique<FitnessCache>(entries);
+            evaluator.Memoization(fitnessCache.get());
+        }
+        evaluator.RetainedParents(result["retain-parents"].as<size_t>());
+        evaluator.JitThreshold(result["jit-threshold"].as<size_t>());
+        evaluator.Simplification(result["simplify"].as<bool>());
+        evaluator.Sorted(maintainHashes);
 
         Expects(problem.TrainingRange().Size() > 0);
 
@@ -313,6 +369,22 @@ int main(int argc, char* argv[])
             problem.StandardizeData(problem.TrainingRange());
         }
 
+        if (result.count("calibrate-batch-size") > 0) {
+            // time the interpreter on a sample of random trees from the initialization distribution
+            // (drawn with a separately seeded generator, so that the run is the same with or without calibration)
+            Operon::Random calibration(config.Seed);
+            std::vector<Tree> trees(config.PopulationSize);
+            std::generate(trees.begin(), trees.end(), [&]() { return creator(calibration, problem.GetGrammar(), inputs); });
+            auto table = CalibrateBatchSize<Operon::Scalar>(trees, problem.GetDataset(), problem.TrainingRange());
+            if (result.count("debug") > 0) {
+                fmt::print("batch sizes:");
+                for (auto s : table) {
+                    fmt::print(" {}", s);
+                }
+                fmt::print("\n");
+            }
+        }
+
         tbb::task_scheduler_init init(threads);
 
         auto t0 = std::chrono::high_resolution_clock::now();
@@ -384,6 +456,23 @@ int main(int argc, char* argv[])
         fmt::print("{:.4f}\t{:.4f}\t{:.4f}\t{:.4f}\t{:.4f}\t{:.4f}\t", r2Train, r2Test, rmseTrain, rmseTest, nmseTrain, nmseTest);
         fmt::print("{:.4f}\t{:.1f}\t{}\t{}\t{}\t", avgQuality, avgLength, evaluator.FitnessEvaluations(), evaluator.LocalEvaluations(), evaluator.TotalEvaluations());
         fmt::print("{}\n", totalMemory); 
+        if (cache && result.count("debug") > 0) {
+            auto stats = cache->GetStatistics();
+            fmt::print("subtree cache: {} lookups, {:.4f} hit rate, {} entries, {} bytes, {} evictions\n", stats.Lookups, stats.HitRate(), stats.Entries, stats.Bytes, stats.Evictions);
+        }
+        if (fitnessCache && result.count("debug") > 0) {
+            auto stats = fitnessCache->GetStatistics();
+            fmt::print("fitness cache: {} cached evaluations, {:.4f} hit rate, {} entries, {} evictions\n", evaluator.CachedEvaluations(), stats.HitRate(), stats.Entries, stats.Evictions);
+        }
+        if (evaluator.RetainedParents() > 0 && result.count("debug") > 0) {
+            fmt::print("incremental evaluations: {}\n", evaluator.IncrementalEvaluations());
+        }
+        if (pop.size() > 1 && result.count("debug") > 0) {
+            PopulationDiversityAnalyzer<Ind> analyzer;
+            analyzer.Sorted(maintainHashes);
+            analyzer.Prepare(pop);
+            fmt::print("diversity: {:.4f}\n", analyzer(random));
+        }
     } catch (std::exception& e) {
         fmt::print("{}\n", e.what());
         std::exit(EXIT_FAILURE);
@@ -20,60 +20,533 @@
 #include <fmt/core.h>
 #include "core/dataset.hpp"
 
-#pragma GCC diagnostic ignored "-Wreorder"
-#pragma GCC diagnostic ignored "-Wignored-qualifiers"
-#pragma GCC diagnostic ignored "-Wunknown-pragmas"
-#include "csv.hpp"
-#pragma GCC diagnostic warning "-Wreorder"
-#pragma GCC diagnostic warning "-Wignored-qualifiers"
-#pragma GCC diagnostic warning "-Wunknown-pragmas"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
 
 namespace Operon {
-Dataset::Dataset(const std::string& file, bool hasHeader)
-{
-    auto info = csv::get_file_info(file);
-    auto nrows = info.n_rows;
-    auto ncols = info.n_cols;
-    variables.resize(ncols);
+namespace {
+    // binary dataset format (see Dataset::Save)
+    constexpr char BinaryMagic[8] = { 'O', 'P', 'E', 'R', 'O', 'N', 'D', 'S' };
+    constexpr uint32_t BinaryVersion = 1;
+    constexpr size_t BinaryAlignment = 64;
 
-    if (hasHeader) {
-        for (auto i = 0; i < ncols; ++i) {
-            variables[i].Name = info.col_names[i];
-            variables[i].Index = i;
+    struct BinaryHeader {
+        char Magic[8];
+        uint32_t Version;
+        uint32_t ScalarSize;
+        uint64_t Rows;
+        uint64_t Cols;
+        uint64_t Stride; // distance between the starts of two consecutive columns, in values
+        uint64_t DataOffset; // start of the first column, in bytes
+    };
+
+    struct BinaryVariable {
+        uint64_t Hash;
+        uint64_t Index;
+        uint64_t NameLength;
+    };
+
+    inline size_t AlignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // csv parsing: the file is split into chunks on line boundaries which are parsed in parallel
+    constexpr size_t MinChunkSize = 1 << 20; // bytes
+    constexpr size_t ChunksPerThread = 4;
+
+    struct CsvChunk {
+        std::vector<std::vector<Operon::Scalar>> Columns;
+        size_t Rows = 0;
+    };
+
+    // removes surrounding whitespace
+    std::string_view Trim(std::string_view s)
+    {
+        constexpr std::string_view junk = " \t\r";
+        auto begin = s.find_first_not_of(junk);
+        if (begin == std::string_view::npos) {
+            return {};
         }
-    } else {
-        for (auto i = 0; i < ncols; ++i) {
-            variables[i].Name = fmt::format("X{}", i + 1);
-            variables[i].Index = i;
+        auto end = s.find_last_not_of(junk);
+        return s.substr(begin, end - begin + 1);
+    }
+
+    // returns the next record and advances past it; a line break inside a quoted field (preceded by an odd number
+    // of quotes within the record) does not end the record
+    std::string_view NextLine(std::string_view& text)
+    {
+        size_t quotes = 0;
+        size_t pos = 0;
+        auto end = text.find('\n');
+        while (end != std::string_view::npos && (quotes += std::count(text.begin() + pos, text.begin() + end, '"')) % 2 != 0) {
+            pos = end;
+            end = text.find('\n', end + 1);
         }
-        variables.back().Name = "Y";
+        auto line = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+        return line;
     }
 
-    csv::CSVReader reader(file);
+    // calls f for each (trimmed) comma-separated field of the line
+    // quoted fields (rfc 4180) may contain commas and line breaks; they are passed without the quotes, with any
+    // doubled quote left as it is (see Unescape)
+    template <typename F>
+    void ForEachField(std::string_view line, F&& f)
+    {
+        while (true) {
+            auto start = line.find_first_not_of(" \t");
+            size_t end = 0;
+            if (start != std::string_view::npos && line[start] == '"') {
+                auto close = start + 1;
+                while ((close = line.find('"', close)) != std::string_view::npos && close + 1 < line.size() && line[close + 1] == '"') {
+                    close += 2;
+                }
+                if (close == std::string_view::npos) {
+                    throw std::runtime_error(fmt::format("Unterminated quoted field in line: {}", line));
+                }
+                end = line.find(',', close + 1);
+                if (!Trim(line.substr(close + 1, end == std::string_view::npos ? end : end - close - 1)).empty()) {
+                    throw std::runtime_error(fmt::format("Unexpected characters after a quoted field in line: {}", line));
+                }
+                f(Trim(line.substr(start + 1, close - start - 1)));
+            } else {
+                end = line.find(',');
+                f(Trim(line.substr(0, end)));
+            }
+            if (end == std::string_view::npos) {
+                return;
+            }
+            line.remove_prefix(end + 1);
+        }
+    }
+
+    // replaces the doubled quotes of a quoted field with single ones
+    std::string Unescape(std::string_view field)
+    {
+        std::string s;
+        s.reserve(field.size());
+        for (size_t i = 0; i < field.size(); ++i) {
+            s.push_back(field[i]);
+            if (field[i] == '"' && i + 1 < field.size() && field[i + 1] == '"') {
+                ++i;
+            }
+        }
+        return s;
+    }
+
+    Operon::Scalar ParseValue(std::string_view field)
+    {
+        if (!field.empty() && field.front() == '+') {
+            field.remove_prefix(1); // not accepted by from_chars
+        }
+        Operon::Scalar value;
+        auto [ptr, ec] = std::from_chars(field.data(), field.data() + field.size(), value);
+        if (ec == std::errc::result_out_of_range && ptr == field.data() + field.size()) {
+            // let strtod deal with denormals and overflow (it returns the nearest representable value)
+            return std::strtod(std::string(field).c_str(), nullptr);
+        }
+        if (field.empty() || ec != std::errc() || ptr != field.data() + field.size()) {
+            throw std::runtime_error(fmt::format("Could not cast {} as a floating-point type.", field));
+        }
+        return value;
+    }
 
-    values = MatrixType(nrows, ncols);
-    gsl::index i = 0;
-    for (auto& row : reader) {
-        gsl::index j = 0;
-        for (auto& field : row) {
-            if (field.is_num()) {
-                values(i, j) = field.get<double>();
+    void ParseChunk(std::string_view text, CsvChunk& chunk, size_t ncols, size_t expectedRows)
+    {
+        chunk.Columns.resize(ncols);
+        for (auto& col : chunk.Columns) {
+            col.reserve(expectedRows);
+        }
+        while (!text.empty()) {
+            auto line = NextLine(text);
+            if (Trim(line).empty()) {
+                continue;
+            }
+            size_t j = 0;
+            ForEachField(line, [&](auto field) {
+                if (j < ncols) {
+                    chunk.Columns[j].push_back(ParseValue(field));
+                }
                 ++j;
-            } else {
-                throw new std::runtime_error(fmt::format("Could not cast {} as a floating-point type.", field.get()));
+            });
+            if (j != ncols) {
+                throw std::runtime_error(fmt::format("Expected {} fields but got {} in line: {}", ncols, j, line));
+            }
+            ++chunk.Rows;
+        }
+    }
+
+    bool IsBinaryFile(const std::string& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        char magic[sizeof(BinaryMagic)];
+        return in.read(magic, sizeof(magic)) && std::memcmp(magic, BinaryMagic, sizeof(magic)) == 0;
+    }
+}
+
+// read-only memory mapping of a whole file
+class Dataset::MappedFile {
+public:
+    explicit MappedFile(const std::string& path)
+    {
+        auto fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            throw std::runtime_error(fmt::format("Could not open {}.", path));
+        }
+        struct stat st;
+        if (::fstat(fd, &st) == -1 || st.st_size == 0) {
+            ::close(fd);
+            throw std::runtime_error(fmt::format("Could not read the size of {}.", path));
+        }
+        size = st.st_size;
+        data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd); // the mapping stays valid after the descriptor is closed
+        if (data == MAP_FAILED) {
+            throw std::runtime_error(fmt::format("Could not map {} into memory.", path));
+        }
+    }
+
+    ~MappedFile() { ::munmap(data, size); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* Data() const { return static_cast<const unsigned char*>(data); }
+    size_t Size() const { return size; }
+
+private:
+    void* data;
+    size_t size;
+};
+
+namespace {
+    // parses the header and the variable table of a binary dataset from the first bytes of the file
+    // (at least up to the data offset or the whole file, whichever is smaller)
+    BinaryHeader ParseBinaryHeader(const unsigned char* bytes, size_t available, size_t fileSize, const std::string& path, std::vector<Variable>& variables)
+    {
+        auto invalid = [&](auto const& reason) { return std::runtime_error(fmt::format("Invalid binary dataset {}: {}.", path, reason)); };
+
+        BinaryHeader header;
+        if (available < sizeof(header)) {
+            throw invalid("truncated header");
+        }
+        std::memcpy(&header, bytes, sizeof(header));
+        if (header.Version != BinaryVersion) {
+            throw invalid(fmt::format("unsupported version {}", header.Version));
+        }
+        if (header.ScalarSize != sizeof(Operon::Scalar)) {
+            throw invalid(fmt::format("values are {}-byte, expected {}-byte", header.ScalarSize, sizeof(Operon::Scalar)));
+        }
+        if (header.Stride < header.Rows || header.DataOffset % BinaryAlignment != 0 || header.DataOffset > fileSize || header.DataOffset > available
+            || (fileSize - header.DataOffset) / sizeof(Operon::Scalar) / std::max(header.Stride, uint64_t { 1 }) < header.Cols) {
+            throw invalid("inconsistent dimensions");
+        }
+
+        variables.resize(header.Cols);
+        size_t offset = sizeof(header);
+        for (auto& v : variables) {
+            BinaryVariable bv;
+            if (offset + sizeof(bv) > header.DataOffset) {
+                throw invalid("truncated variable table");
+            }
+            std::memcpy(&bv, bytes + offset, sizeof(bv));
+            offset += sizeof(bv);
+            if (bv.NameLength > header.DataOffset - offset || bv.Index >= header.Cols) {
+                throw invalid("truncated variable table");
+            }
+            v.Name.assign(reinterpret_cast<const char*>(bytes + offset), bv.NameLength);
+            v.Hash = static_cast<Operon::Hash>(bv.Hash);
+            v.Index = static_cast<gsl::index>(bv.Index);
+            offset += bv.NameLength;
+        }
+        return header;
+    }
+}
+
+void Dataset::LoadBinary(const std::string& path)
+{
+    auto mapped = std::make_shared<const MappedFile>(path);
+    auto header = ParseBinaryHeader(mapped->Data(), mapped->Size(), mapped->Size(), path, variables);
+    auto data = reinterpret_cast<const Operon::Scalar*>(mapped->Data() + header.DataOffset);
+    new (&map) MapType(data, header.Rows, header.Cols, Eigen::OuterStride<>(header.Stride));
+    values.resize(0, 0);
+    file = std::move(mapped);
+    BuildIndex();
+}
+
+DatasetStream::DatasetStream(const std::string& path, size_t blockRows)
+{
+    Expects(blockRows > 0);
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::runtime_error(fmt::format("Could not open {}.", path));
+    }
+    try {
+        struct stat st;
+        if (::fstat(fd, &st) == -1) {
+            throw std::runtime_error(fmt::format("Could not read the size of {}.", path));
+        }
+        size_t fileSize = st.st_size;
+
+        // read the fixed size header first to find out how large the variable table is
+        std::vector<unsigned char> bytes(std::min(sizeof(BinaryHeader), fileSize));
+        if (!IsBinaryFile(path) || ::pread(fd, bytes.data(), bytes.size(), 0) != static_cast<ssize_t>(bytes.size())) {
+            throw std::runtime_error(fmt::format("Invalid binary dataset {}: not a binary dataset.", path));
+        }
+        BinaryHeader header;
+        std::memcpy(&header, bytes.data(), std::min(sizeof(header), bytes.size()));
+        bytes.resize(std::min(static_cast<size_t>(header.DataOffset), fileSize));
+        if (::pread(fd, bytes.data(), bytes.size(), 0) != static_cast<ssize_t>(bytes.size())) {
+            throw std::runtime_error(fmt::format("Could not read {}.", path));
+        }
+
+        std::vector<Variable> variables;
+        header = ParseBinaryHeader(bytes.data(), bytes.size(), fileSize, path, variables);
+        rows = header.Rows;
+        stride = header.Stride;
+        dataOffset = header.DataOffset;
+        block = Dataset(std::move(variables), Dataset::MatrixType(std::min(blockRows, std::max(rows, size_t { 1 })), header.Cols));
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+}
+
+DatasetStream::~DatasetStream()
+{
+    ::close(fd);
+}
+
+size_t DatasetStream::Load(size_t row)
+{
+    Expects(row <= rows);
+    auto n = std::min(BlockRows(), rows - row);
+    for (auto const& v : block.Variables()) {
+        auto bytes = n * sizeof(Operon::Scalar);
+        auto offset = dataOffset + (v.Index * stride + row) * sizeof(Operon::Scalar);
+        auto dst = reinterpret_cast<char*>(block.values.col(v.Index).data());
+        for (size_t done = 0; done < bytes;) {
+            auto r = ::pread(fd, dst + done, bytes - done, static_cast<off_t>(offset + done));
+            if (r <= 0) {
+                throw std::runtime_error(fmt::format("Could not read rows {}-{} of the binary dataset.", row, row + n));
             }
+            done += static_cast<size_t>(r);
         }
-        ++i;
+    }
+    block.Refresh();
+    return n;
+}
+
+void Dataset::Save(const std::string& path) const
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error(fmt::format("Could not open {} for writing.", path));
+    }
+
+    BinaryHeader header;
+    std::memcpy(header.Magic, BinaryMagic, sizeof(BinaryMagic));
+    header.Version = BinaryVersion;
+    header.ScalarSize = sizeof(Operon::Scalar);
+    header.Rows = Rows();
+    header.Cols = Cols();
+    header.Stride = AlignUp(Rows(), BinaryAlignment / sizeof(Operon::Scalar));
+
+    size_t tableSize = 0;
+    for (auto const& v : variables) {
+        tableSize += sizeof(BinaryVariable) + v.Name.size();
+    }
+    header.DataOffset = AlignUp(sizeof(header) + tableSize, BinaryAlignment);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (auto const& v : variables) {
+        BinaryVariable bv { static_cast<uint64_t>(v.Hash), static_cast<uint64_t>(v.Index), v.Name.size() };
+        out.write(reinterpret_cast<const char*>(&bv), sizeof(bv));
+        out.write(v.Name.data(), v.Name.size());
+    }
+
+    std::vector<char> padding(header.DataOffset - sizeof(header) - tableSize, 0);
+    out.write(padding.data(), padding.size());
+
+    padding.assign((header.Stride - header.Rows) * sizeof(Operon::Scalar), 0);
+    for (gsl::index i = 0; i < map.cols(); ++i) {
+        out.write(reinterpret_cast<const char*>(map.col(i).data()), header.Rows * sizeof(Operon::Scalar));
+        out.write(padding.data(), padding.size());
+    }
+
+    if (!out) {
+        throw std::runtime_error(fmt::format("Could not write {}.", path));
+    }
+}
+
+Dataset::Dataset(const std::string& file, bool hasHeader)
+{
+    if (IsBinaryFile(file)) {
+        LoadBinary(file);
+        return;
+    }
+
+    MappedFile input(file);
+    std::string_view text(reinterpret_cast<const char*>(input.Data()), input.Size());
+    if (text.substr(0, 3) == "\xEF\xBB\xBF") {
+        text.remove_prefix(3); // utf-8 byte order mark
+    }
+
+    // the first line gives the number of columns (and their names if there is a header)
+    auto rest = text;
+    auto first = NextLine(rest);
+    size_t ncols = 0;
+    ForEachField(first, [&](auto field) {
+        variables.push_back(Variable { hasHeader ? Unescape(field) : fmt::format("X{}", ncols + 1), 0, static_cast<gsl::index>(ncols) });
+        ++ncols;
+    });
+    if (hasHeader) {
+        text = rest;
+    } else {
+        variables.back().Name = "Y";
     }
 
+    // split the data on line boundaries and parse the chunks in parallel, without counting the rows beforehand
+    // (a file with quoted fields is parsed as a single chunk, since a line break may then be inside a field)
+    size_t maxChunks = ChunksPerThread * static_cast<size_t>(tbb::this_task_arena::max_concurrency());
+    size_t nchunks = text.find('"') == std::string_view::npos ? std::clamp(text.size() / MinChunkSize, size_t { 1 }, maxChunks) : 1;
+    std::vector<size_t> bounds(nchunks + 1, text.size());
+    bounds[0] = 0;
+    for (size_t k = 1; k < nchunks; ++k) {
+        auto pos = std::max(bounds[k - 1], k * text.size() / nchunks);
+        auto eol = text.find('\n', pos);
+        bounds[k] = eol == std::string_view::npos ? text.size() : eol + 1;
+    }
+
+    std::vector<CsvChunk> chunks(nchunks);
+    auto lineLength = std::max(first.size(), size_t { 1 });
+    tbb::parallel_for(size_t { 0 }, nchunks, [&](size_t k) {
+        auto chunk = text.substr(bounds[k], bounds[k + 1] - bounds[k]);
+        ParseChunk(chunk, chunks[k], ncols, chunk.size() / lineLength + 1);
+    });
+
+    // copy the column fragments into the final column-major storage
+    std::vector<size_t> offsets(nchunks + 1, 0);
+    for (size_t k = 0; k < nchunks; ++k) {
+        offsets[k + 1] = offsets[k] + chunks[k].Rows;
+    }
+    values = MatrixType(offsets.back(), ncols);
+    tbb::parallel_for(size_t { 0 }, nchunks, [&](size_t k) {
+        for (size_t j = 0; j < ncols; ++j) {
+            auto const& col = chunks[k].Columns[j];
+            std::copy(col.begin(), col.end(), values.col(j).data() + offsets[k]);
+        }
+    });
+
     std::sort(variables.begin(), variables.end(), [&](const Variable& a, const Variable& b) { return CompareWithSize(a.Name, b.Name); });
     // fill in variable hash values using a fixed seed
     Operon::RandomGenerator::JsfRand<Operon::HashBits> random(1234);
     std::vector<Operon::Hash> hashes(ncols);
     std::generate(hashes.begin(), hashes.end(), [&]() { return random(); });
     std::sort(hashes.begin(), hashes.end());
-    for (auto i = 0; i < ncols; ++i) {
+    for (size_t i = 0; i < ncols; ++i) {
         variables[i].Hash = hashes[i];
     }
+    Bind();
+    BuildIndex();
+}
+
+void Dataset::Shuffle(Operon::Random& random)
+{
+    Detach();
+    // row i moves to position perm[i]
+    std::vector<gsl::index> perm(values.rows());
+    std::iota(perm.begin(), perm.end(), gsl::index { 0 });
+    std::shuffle(perm.begin(), perm.end(), random);
+
+    // the permutation is applied by following its cycles, which needs no storage besides one element of each cycle
+    std::vector<gsl::index> cycles;
+    std::vector<bool> visited(perm.size(), false);
+    for (size_t i = 0; i < perm.size(); ++i) {
+        if (visited[i]) {
+            continue;
+        }
+        if (perm[i] != static_cast<gsl::index>(i)) {
+            cycles.push_back(i);
+        }
+        for (auto j = static_cast<gsl::index>(i); !visited[j]; j = perm[j]) {
+            visited[j] = true;
+        }
+    }
+
+    tbb::parallel_for(tbb::blocked_range<gsl::index>(0, values.cols()), [&](const auto& r) {
+        for (auto c = r.begin(); c < r.end(); ++c) {
+            auto* x = values.col(c).data();
+            for (auto start : cycles) {
+                auto carry = x[start];
+                auto j = start;
+                do {
+                    j = perm[j];
+                    std::swap(carry, x[j]);
+                } while (j != start);
+            }
+        }
+    });
+    Refresh();
+}
+
+template <typename F>
+void Dataset::Scale(gsl::span<const gsl::index> columns, F&& f)
+{
+    Detach();
+    if (scaling.empty()) {
+        scaling.resize(values.cols());
+    }
+    // one column per task: the statistics and the update are each a single sequential pass over the column
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, columns.size(), 1), [&](const auto& r) {
+        for (auto k = r.begin(); k < r.end(); ++k) {
+            auto col = values.col(columns[k]);
+            Scaling s = f(col);
+            // a constant column (zero range or deviation) is only centered, instead of becoming nan or inf
+            if (!(s.Scale > 0) || !std::isfinite(s.Scale)) {
+                s.Scale = 1;
+            }
+            col = (col - s.Offset) / s.Scale;
+            // compose with the previous scaling of the column
+            auto& acc = scaling[columns[k]];
+            acc.Offset += s.Offset * acc.Scale;
+            acc.Scale *= s.Scale;
+        }
+    });
+    Refresh();
+}
+
+void Dataset::Normalize(gsl::span<const gsl::index> columns, Range range)
+{
+    Expects(range.Start() + range.Size() <= Rows());
+    Scale(columns, [&](const auto& col) {
+        auto seg = col.segment(range.Start(), range.Size());
+        auto min = seg.minCoeff();
+        auto max = seg.maxCoeff();
+        return Scaling { min, max - min };
+    });
+}
+
+void Dataset::Standardize(gsl::span<const gsl::index> columns, Range range)
+{
+    Expects(range.Start() + range.Size() <= Rows());
+    Scale(columns, [&](const auto& col) {
+        MeanVarianceCalculator calc;
+        calc.Add(gsl::span<const Operon::Scalar>(col.data() + range.Start(), range.Size()));
+        return Scaling { calc.Mean(), calc.StandardDeviation() };
+    });
 }
 }
@@ -0,0 +1,55 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+#include "core/fitnesscache.hpp"
+
+namespace Operon {
+FitnessCache::FitnessCache(size_t capacityEntries, Eviction evictionPolicy)
+    : cache(capacityEntries, evictionPolicy)
+{
+}
+
+bool FitnessCache::Find(Operon::Hash hash, Entry& entry)
+{
+    return cache.Find(hash, [&](const Entry& cached) {
+        entry.Fitness = cached.Fitness;
+        entry.Coefficients.assign(cached.Coefficients.begin(), cached.Coefficients.end());
+    });
+}
+
+void FitnessCache::Insert(Operon::Hash hash, const Entry& entry)
+{
+    cache.Insert(hash, entry);
+}
+
+void FitnessCache::Clear()
+{
+    cache.Clear();
+}
+
+FitnessCache::Statistics FitnessCache::GetStatistics() const noexcept
+{
+    auto s = cache.GetStatistics();
+    return Statistics { s.Lookups, s.Hits, s.Insertions, s.Evictions, s.Entries };
+}
+
+void FitnessCache::ResetStatistics() noexcept
+{
+    cache.ResetStatistics();
+}
+} // namespace Operon
@@ -0,0 +1,296 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#include "core/jit.hpp"
+#include "core/eval.hpp"
+
+#include <cstring>
+#include <initializer_list>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define OPERON_NATIVE_CODE
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Operon {
+namespace {
+    constexpr size_t Lanes = 4; // doubles per AVX2 register
+
+    // general purpose registers: the arguments are passed in rdi (columns), rsi (result), rdx (values) and
+    // rcx (rows, moved to r8 such that rcx can hold the current data column); rax is the row index
+    constexpr int RAX = 0;
+    constexpr int RCX = 1;
+    constexpr int RDX = 2;
+    constexpr int RSI = 6;
+    constexpr int RDI = 7;
+
+    // vector registers: ymm0-ymm14 hold the stack slots (buffer columns), ymm15 the variable weights
+    constexpr int Temp = 15;
+
+    // minimal encoder for the handful of AVX instructions used by the generated code (all 256-bit, 66 prefix)
+    struct Assembler {
+        std::vector<uint8_t> Code;
+
+        void Emit(std::initializer_list<uint8_t> bytes) { Code.insert(Code.end(), bytes); }
+
+        void Emit32(int32_t value)
+        {
+            for (int i = 0; i < 4; ++i) {
+                Code.push_back(static_cast<uint8_t>(static_cast<uint32_t>(value) >> (8 * i)));
+            }
+        }
+
+        static uint8_t ModRM(int mod, int reg, int rm) { return static_cast<uint8_t>(mod << 6 | (reg & 7) << 3 | (rm & 7)); }
+
+        // three byte VEX prefix: map 1 = 0F, map 2 = 0F38; vvvv is the first source operand (0 if unused)
+        void Vex(uint8_t map, int reg, int vvvv, int rm)
+        {
+            auto r = (~reg >> 3) & 1;
+            auto b = (~rm >> 3) & 1;
+            Emit({ 0xC4, static_cast<uint8_t>(r << 7 | 1 << 6 | b << 5 | map), static_cast<uint8_t>((~vvvv & 15) << 3 | 1 << 2 | 1) });
+        }
+
+        // op ymm(dst), ymm(lhs), ymm(rhs)
+        void Op(uint8_t opcode, int dst, int lhs, int rhs)
+        {
+            Vex(1, dst, lhs, rhs);
+            Emit({ opcode, ModRM(3, dst, rhs) });
+        }
+
+        // op ymm(dst), ymm(lhs), [base + rax * 8]
+        void OpRows(uint8_t opcode, int dst, int lhs, int base)
+        {
+            Vex(1, dst, lhs, 0);
+            Emit({ opcode, ModRM(0, dst, 4), ModRM(3, RAX, base) });
+        }
+
+        // vmovupd [rsi + rax * 8], ymm(src)
+        void StoreRows(int src)
+        {
+            Vex(1, src, 0, 0);
+            Emit({ 0x11, ModRM(0, src, 4), ModRM(3, RAX, RSI) });
+        }
+
+        // vbroadcastsd ymm(dst), [rdx + offset]
+        void Broadcast(int dst, int32_t offset)
+        {
+            Vex(2, dst, 0, 0);
+            Emit({ 0x19, ModRM(2, dst, RDX) });
+            Emit32(offset);
+        }
+
+        // mov rcx, [rdi + offset]
+        void LoadColumn(int32_t offset)
+        {
+            Emit({ 0x48, 0x8B, ModRM(2, RCX, RDI) });
+            Emit32(offset);
+        }
+    };
+
+    constexpr uint8_t VMOVUPD = 0x10;
+    constexpr uint8_t VSQRTPD = 0x51;
+    constexpr uint8_t VADDPD = 0x58;
+    constexpr uint8_t VMULPD = 0x59;
+    constexpr uint8_t VSUBPD = 0x5C;
+    constexpr uint8_t VDIVPD = 0x5E;
+
+    // generates the loop over blocks of Lanes rows (the number of rows must be a positive multiple of Lanes)
+    bool Generate(const EvaluationPlan& plan, Assembler& a)
+    {
+        auto const& code = plan.Instructions();
+        if (code.empty() || plan.Layout() != BufferLayout::Stack || plan.BufferSize() > static_cast<size_t>(Temp)) {
+            return false;
+        }
+
+        a.Code.clear();
+        a.Emit({ 0x49, 0x89, 0xC8 }); // mov r8, rcx
+        a.Emit({ 0x31, 0xC0 }); // xor eax, eax
+        auto loop = static_cast<int32_t>(a.Code.size());
+
+        for (size_t i = 0; i < code.size(); ++i) {
+            auto const& s = code[i];
+            if (s.Output != nullptr) {
+                return false;
+            }
+            int dst = s.Column;
+            auto const* c = plan.Operands(s);
+            auto offset = static_cast<int32_t>(i * sizeof(Operon::Scalar));
+            bool binary = s.Arity == 2;
+            bool unary = s.Arity == 1;
+
+            switch (s.Type) {
+            case NodeType::Add:
+            case NodeType::Mul: {
+                // n-ary, accumulated from the last child whose register is the destination (like the interpreter)
+                if (s.Arity < 2) {
+                    return false;
+                }
+                auto op = s.Type == NodeType::Add ? VADDPD : VMULPD;
+                a.Op(op, dst, c[s.Arity - 1], c[s.Arity - 2]);
+                for (int k = s.Arity - 3; k >= 0; --k) {
+                    a.Op(op, dst, dst, c[k]);
+                }
+                break;
+            }
+            case NodeType::Sub:
+                if (!binary) {
+                    return false;
+                }
+                a.Op(VSUBPD, dst, c[0], c[1]);
+                break;
+            case NodeType::Div:
+                if (!binary) {
+                    return false;
+                }
+                a.Op(VDIVPD, dst, c[0], c[1]);
+                break;
+            case NodeType::Square:
+                if (!unary) {
+                    return false;
+                }
+                a.Op(VMULPD, dst, c[0], c[0]);
+                break;
+            case NodeType::Sqrt:
+                if (!unary) {
+                    return false;
+                }
+                a.Op(VSQRTPD, dst, 0, c[0]);
+                break;
+            case NodeType::Constant:
+                a.Broadcast(dst, offset);
+                break;
+            case NodeType::Variable:
+                a.Broadcast(Temp, offset);
+                a.LoadColumn(offset);
+                a.OpRows(VMULPD, dst, Temp, RCX);
+                break;
+            default:
+                return false;
+            }
+        }
+        a.StoreRows(code.back().Column);
+
+        a.Emit({ 0x48, 0x83, 0xC0, static_cast<uint8_t>(Lanes) }); // add rax, Lanes
+        a.Emit({ 0x4C, 0x39, 0xC0 }); // cmp rax, r8
+        a.Emit({ 0x0F, 0x82 }); // jb loop
+        a.Emit32(loop - static_cast<int32_t>(a.Code.size() + 4));
+        a.Emit({ 0xC5, 0xF8, 0x77 }); // vzeroupper
+        a.Emit({ 0xC3 }); // ret
+        return true;
+    }
+} // namespace
+
+NativePlan::~NativePlan()
+{
+#ifdef OPERON_NATIVE_CODE
+    if (memory != nullptr) {
+        munmap(memory, capacity);
+    }
+#endif
+}
+
+bool NativePlan::Supported() noexcept
+{
+#ifdef OPERON_NATIVE_CODE
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+bool NativePlan::Compile(const EvaluationPlan& p)
+{
+    Clear();
+
+#ifdef OPERON_NATIVE_CODE
+    thread_local Assembler assembler;
+    if (!Supported() || !Generate(p, assembler)) {
+        return false;
+    }
+
+    auto const& code = assembler.Code;
+    if (code.size() > capacity) {
+        if (memory != nullptr) {
+            munmap(memory, capacity);
+        }
+        auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        capacity = (code.size() + page - 1) / page * page;
+        memory = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            memory = nullptr;
+            capacity = 0;
+            return false;
+        }
+    } else if (mprotect(memory, capacity, PROT_READ | PROT_WRITE) != 0) {
+        return false;
+    }
+    // the memory is never writable and executable at the same time
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, capacity, PROT_READ | PROT_EXEC) != 0) {
+        return false;
+    }
+
+    plan = &p;
+    function = reinterpret_cast<Function>(memory);
+    size = code.size();
+    return true;
+#else
+    return false;
+#endif
+}
+
+void NativePlan::Evaluate(Range range, Operon::Scalar const* parameters, gsl::span<Operon::Scalar> result) const
+{
+    Expects(IsCompiled());
+    auto const& code = plan->Instructions();
+    size_t n = range.Size();
+    if (n < Lanes) {
+        Operon::Evaluate<Operon::Scalar>(*plan, range, parameters, result);
+        return;
+    }
+
+    thread_local std::vector<Operon::Scalar const*> columns;
+    thread_local std::vector<Operon::Scalar> values;
+    columns.resize(code.size());
+    values.resize(code.size());
+    for (size_t i = 0; i < code.size(); ++i) {
+        auto const& s = code[i];
+        values[i] = parameters == nullptr || s.Coefficient < 0 ? s.Value : parameters[s.Coefficient];
+        columns[i] = s.Data == nullptr ? nullptr : s.Data + range.Start();
+    }
+
+    auto m = n - n % Lanes;
+    function(columns.data(), result.data(), values.data(), m);
+    if (m < n) {
+        // the remaining rows are evaluated as the last block of Lanes rows, overlapping the previous one
+        for (auto& column : columns) {
+            if (column != nullptr) {
+                column += n - Lanes;
+            }
+        }
+        function(columns.data(), result.data() + n - Lanes, values.data(), Lanes);
+    }
+
+    // replace nan and inf values
+    auto [min, max] = MinMax(result);
+    LimitToRange(result, min, max);
+}
+} // namespace Operon
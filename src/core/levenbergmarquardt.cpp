@@ -0,0 +1,182 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#include "core/levenbergmarquardt.hpp"
+
+#include <Eigen/Cholesky>
+
+namespace Operon {
+double LevenbergMarquardtSolver::Evaluate(double const* coefficients, double* jtjOut, double* jtrOut)
+{
+    gsl::index n = cost.Plan().CoefficientsCount();
+    gsl::index numRows = cost.GetRange().Size();
+    auto target = cost.TargetValues();
+    bool normalEquations = jtjOut != nullptr;
+
+    Eigen::Map<Eigen::MatrixXd> jtjMap(jtjOut, n, n);
+    Eigen::Map<Eigen::VectorXd> jtrMap(jtrOut, n);
+    if (normalEquations) {
+        jtjMap.setZero();
+        jtrMap.setZero();
+    }
+
+    double sum = 0;
+    for (gsl::index row = 0; row < numRows; row += BATCHSIZE) {
+        auto remainingRows = std::min(BATCHSIZE, numRows - row);
+        ReverseModeCostFunction::JacobianMap jac(jacobian.data(), remainingRows, n, Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>(remainingRows, 1));
+        cost.EvaluateBatch(coefficients, row, remainingRows, residuals.data(), normalEquations ? &jac : nullptr);
+
+        Eigen::Map<Eigen::VectorXd> r(residuals.data(), remainingRows);
+        for (gsl::index i = 0; i < remainingRows; ++i) {
+            r(i) -= target[row + i];
+            if (!std::isfinite(r(i))) {
+                r(i) = 0;
+                if (normalEquations) {
+                    jac.row(i).setZero();
+                }
+            } else if (normalEquations && !jac.row(i).isFinite().all()) {
+                jac.row(i).setZero();
+            }
+        }
+        sum += r.squaredNorm();
+
+        if (normalEquations) {
+            Eigen::Map<Eigen::MatrixXd> j(jacobian.data(), remainingRows, n);
+            jtjMap.selfadjointView<Eigen::Lower>().rankUpdate(j.transpose());
+            jtrMap.noalias() += j.transpose() * r;
+        }
+    }
+    return 0.5 * sum;
+}
+
+LevenbergMarquardtSolver::Summary LevenbergMarquardtSolver::Optimize(Tree& tree, EvaluationPlan& plan, const gsl::span<const Operon::Scalar> targetValues, const Range range, size_t iterations, bool writeCoefficients)
+{
+    if (plan.CoefficientsCount() == 0 || iterations == 0) {
+        return Summary {};
+    }
+    cost.Reset(plan, targetValues, range);
+    return Solve(tree, plan, iterations, writeCoefficients);
+}
+
+LevenbergMarquardtSolver::Summary LevenbergMarquardtSolver::Optimize(Tree& tree, EvaluationPlan& plan, const gsl::span<const Operon::Scalar> targetValues, gsl::span<const gsl::index> rows, size_t iterations, bool writeCoefficients)
+{
+    if (plan.CoefficientsCount() == 0 || iterations == 0) {
+        return Summary {};
+    }
+    cost.Reset(plan, targetValues, rows);
+    return Solve(tree, plan, iterations, writeCoefficients);
+}
+
+LevenbergMarquardtSolver::Summary LevenbergMarquardtSolver::Solve(Tree& tree, EvaluationPlan& plan, size_t iterations, bool writeCoefficients)
+{
+    Summary summary;
+    gsl::index n = plan.CoefficientsCount();
+    x.resize(n);
+    candidate.resize(n);
+    jtj.resize(n * n);
+    jtr.resize(n);
+    candidateJtj.resize(n * n);
+    candidateJtr.resize(n);
+    system.resize(n * n);
+    step.resize(n);
+    jacobian.resize(BATCHSIZE * n);
+    residuals.resize(BATCHSIZE);
+
+    for (auto const& s : plan.Instructions()) {
+        if (s.Coefficient >= 0) {
+            x[s.Coefficient] = s.Value;
+        }
+    }
+
+    Eigen::Map<Eigen::VectorXd> xMap(x.data(), n);
+    Eigen::Map<Eigen::VectorXd> candidateMap(candidate.data(), n);
+    Eigen::Map<Eigen::MatrixXd> jtjMap(jtj.data(), n, n);
+    Eigen::Map<Eigen::VectorXd> jtrMap(jtr.data(), n);
+    Eigen::Map<Eigen::MatrixXd> candidateJtjMap(candidateJtj.data(), n, n);
+    Eigen::Map<Eigen::VectorXd> candidateJtrMap(candidateJtr.data(), n);
+    Eigen::Map<Eigen::MatrixXd> systemMap(system.data(), n, n);
+    Eigen::Map<Eigen::VectorXd> stepMap(step.data(), n);
+
+    auto f = Evaluate(x.data(), jtj.data(), jtr.data());
+    ++summary.Evaluations;
+    summary.InitialCost = f;
+
+    double mu = 1e-4; // damping factor (inverse of ceres' initial trust region radius)
+    double nu = 2;
+
+    for (size_t it = 0; it < iterations; ++it) {
+        ++summary.Iterations;
+        if (jtrMap.lpNorm<Eigen::Infinity>() <= GradientTolerance) {
+            summary.Converged = true;
+            break;
+        }
+
+        // solve (J'J + mu * D) * step = -J'r, where D is the (clamped) diagonal of J'J
+        systemMap.triangularView<Eigen::Lower>() = jtjMap;
+        systemMap.diagonal().array() += mu * jtjMap.diagonal().array().max(1e-6).min(1e32);
+        stepMap = -jtrMap;
+        Eigen::LLT<Eigen::Ref<Eigen::MatrixXd>, Eigen::Lower> llt(systemMap);
+        if (llt.info() != Eigen::Success) {
+            mu *= nu;
+            nu *= 2;
+            continue;
+        }
+        llt.solveInPlace(stepMap);
+
+        if (stepMap.norm() <= ParameterTolerance * (xMap.norm() + ParameterTolerance)) {
+            summary.Converged = true;
+            break;
+        }
+
+        // the normal equations are accumulated along with the trial cost, so an accepted step needs no further evaluation
+        candidateMap = xMap + stepMap;
+        auto fc = Evaluate(candidate.data(), candidateJtj.data(), candidateJtr.data());
+        ++summary.Evaluations;
+
+        // gain ratio between the actual and the predicted (by the linear model) reduction of the cost
+        auto predicted = 0.5 * stepMap.dot(mu * (jtjMap.diagonal().array().max(1e-6).min(1e32) * stepMap.array()).matrix() - jtrMap);
+        auto rho = (f - fc) / predicted;
+
+        if (std::isfinite(fc) && predicted > 0 && rho > 0) {
+            auto decrease = f - fc;
+            xMap = candidateMap;
+            jtjMap.triangularView<Eigen::Lower>() = candidateJtjMap;
+            jtrMap = candidateJtrMap;
+            f = fc;
+            ++summary.SuccessfulSteps;
+            mu *= std::max(1.0 / 3.0, 1.0 - std::pow(2 * rho - 1, 3));
+            nu = 2;
+            if (decrease <= FunctionTolerance * f) {
+                summary.Converged = true;
+                break;
+            }
+        } else {
+            mu *= nu;
+            nu *= 2;
+        }
+    }
+    summary.FinalCost = f;
+
+    if (writeCoefficients) {
+        tree.SetCoefficients(x);
+        plan.SetCoefficients(x);
+    }
+    return summary;
+}
+} // namespace Operon
@@ -26,10 +26,12 @@ Operon::Scalar NormalizedMeanSquaredError(gsl::span<const Operon::Scalar> x, gsl
     Expects(x.size() > 0);
     MeanVarianceCalculator ycalc;
     MeanVarianceCalculator errcalc;
+    // rows with a missing (non-finite) target are left out
     for(int i = 0; i < x.size(); ++i) {
-        if (!std::isnan(y[i])) {
-            ycalc.Add(y[i]);
+        if (!std::isfinite(y[i])) {
+            continue;
         }
+        ycalc.Add(y[i]);
         auto e = x[i] - y[i];
         errcalc.Add(e * e);
     }
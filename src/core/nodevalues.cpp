@@ -0,0 +1,86 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#include "core/nodevalues.hpp"
+#include "core/eval.hpp"
+
+namespace Operon {
+void NodeValues::Compute(const Tree& tree, const Dataset& dataset, Range r)
+{
+    nodes = tree.Nodes();
+    range = r;
+    values.resize(nodes.size() * range.Size());
+
+    thread_local EvaluationPlan plan;
+    thread_local EvaluationPlan derived;
+    thread_local std::vector<std::pair<gsl::index, Operon::Scalar*>> stores;
+    thread_local Operon::Vector<Operon::Scalar> result;
+
+    plan.Compile(tree, dataset);
+    stores.clear();
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        stores.emplace_back(i, values.data() + i * range.Size());
+    }
+    derived.Derive(plan, range, {}, stores);
+    result.resize(range.Size());
+    Evaluate<Operon::Scalar>(derived, Range { 0, range.Size() }, nullptr, result);
+}
+
+size_t NodeValues::SharedSubtrees(const Tree& other, std::vector<std::pair<gsl::index, Operon::Scalar const*>>* loads) const
+{
+    thread_local std::vector<size_t> changed;
+
+    auto [prefix, suffix] = CommonAffixes(other);
+    auto const& others = other.Nodes();
+    gsl::index n = others.size();
+    gsl::index shift = n - static_cast<gsl::index>(nodes.size()); // offset of the nodes of the suffix in other
+    gsl::index prefixEnd = prefix;
+    gsl::index suffixStart = n - suffix;
+
+    // changed[i + 1] - changed[j] counts the nodes in [j, i] which are outside the affixes or have another coefficient
+    changed.resize(n + 1);
+    changed[0] = 0;
+    for (gsl::index i = 0; i < n; ++i) {
+        bool differs = true;
+        if (i < prefixEnd) {
+            differs = nodes[i].Value != others[i].Value;
+        } else if (i >= suffixStart) {
+            differs = nodes[i - shift].Value != others[i].Value;
+        }
+        changed[i + 1] = changed[i] + differs;
+    }
+
+    // top-down, taking the largest shared subtrees
+    size_t reused = 0;
+    for (gsl::index i = n - 1; i >= 0; --i) {
+        auto start = i - static_cast<gsl::index>(others[i].Length);
+        // the subtree must lie entirely within one of the affixes: when the child is shorter than the parent, a
+        // subtree spanning both affixes (with nothing changed in between) is not the one at the same position
+        if (changed[i + 1] != changed[start] || (i >= prefixEnd && start < suffixStart)) {
+            continue;
+        }
+        if (loads != nullptr) {
+            loads->emplace_back(i, Column(i < prefixEnd ? i : i - shift));
+        }
+        reused += others[i].Length + 1;
+        i = start;
+    }
+    return reused;
+}
+} // namespace Operon
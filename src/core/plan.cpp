@@ -0,0 +1,172 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#include "core/plan.hpp"
+
+#include <algorithm>
+
+namespace Operon {
+EvaluationPlan::EvaluationPlan(const Tree& tree, const Dataset& ds, BufferLayout bufferLayout)
+{
+    Compile(tree, ds, bufferLayout);
+}
+
+void EvaluationPlan::Compile(const Tree& tree, const Dataset& ds, BufferLayout bufferLayout)
+{
+    const auto& nodes = tree.Nodes();
+    instructions.clear();
+    hashes.clear();
+    operands.clear();
+    instructions.reserve(nodes.size());
+    hashes.reserve(nodes.size());
+    operands.reserve(nodes.size());
+    bufferSize = 0;
+    layout = bufferLayout;
+    dataset = &ds;
+
+    // in postfix order the children of a node are the topmost values on the evaluation stack,
+    // with the first child on top; a node's result takes the place of its last child
+    gsl::index stackSize = 0;
+
+    gsl::index idx = 0;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const auto& s = nodes[i];
+
+        Instruction instruction;
+        instruction.Type = s.Type;
+        instruction.Arity = s.Arity;
+        instruction.Length = s.Length;
+        instruction.Column = layout == BufferLayout::Linear ? i : stackSize - s.Arity;
+        instruction.Operands = operands.size();
+        instruction.Coefficient = -1;
+        instruction.Value = s.Value;
+        instruction.Data = nullptr;
+        instruction.SingleData = nullptr;
+        instruction.Output = nullptr;
+
+        if (s.IsConstant() || s.IsVariable()) {
+            instruction.Coefficient = idx++;
+        }
+        if (s.IsVariable()) {
+            auto column = ds.GetIndex(s.HashValue);
+            instruction.Data = ds.Values().col(column).data();
+            instruction.SingleData = ds.HasSinglePrecision() ? ds.GetSingleValues(column).data() : nullptr;
+        }
+        gsl::index k = 0;
+        for (auto it = tree.Children(i); it.HasNext(); ++it, ++k) {
+            operands.push_back(layout == BufferLayout::Linear ? it.Index() : stackSize - 1 - k);
+        }
+        stackSize += 1 - s.Arity;
+        bufferSize = std::max(bufferSize, static_cast<size_t>(instruction.Column + 1));
+        instructions.push_back(instruction);
+        hashes.push_back(s.HashValue);
+    }
+    coefficientsCount = idx;
+}
+
+void EvaluationPlan::SubtreeHashes(std::vector<Operon::Hash>& subtreeHashes) const
+{
+    Expects(dataset != nullptr);
+    // the dataset version (rather than the address of the columns) tells whether the values were modified in place
+    // or belong to another dataset whose storage happens to be at the same address
+    auto version = static_cast<Operon::Hash>(dataset->Version());
+    subtreeHashes.resize(instructions.size());
+    std::vector<Operon::Hash> buf;
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        auto const& s = instructions[i];
+        if (s.Arity == 0) {
+            auto valueHash = xxh::xxhash3<Operon::HashBits>({ s.Value });
+            subtreeHashes[i] = xxh::xxhash3<Operon::HashBits>({ hashes[i], valueHash, version });
+            continue;
+        }
+        // the node hash followed by the subtree hashes of the children, in order
+        buf.clear();
+        buf.push_back(hashes[i]);
+        for (gsl::index j = i - 1, k = 0; k < s.Arity; j -= instructions[j].Length + 1, ++k) {
+            buf.push_back(subtreeHashes[j]);
+        }
+        subtreeHashes[i] = xxh::xxhash3<Operon::HashBits>(buf);
+    }
+}
+
+void EvaluationPlan::Derive(const EvaluationPlan& plan, Range range, gsl::span<const std::pair<gsl::index, Operon::Scalar const*>> loads, gsl::span<const std::pair<gsl::index, Operon::Scalar*>> stores)
+{
+    // the buffer columns and operands are unchanged: a loaded subtree's root keeps its column and its descendants
+    // only wrote to columns which are dead once the root is computed
+    instructions.clear();
+    hashes.clear();
+    operands = plan.operands;
+    dataset = nullptr;
+    coefficientsCount = plan.coefficientsCount;
+    bufferSize = plan.bufferSize;
+    layout = plan.layout;
+
+    auto const& code = plan.instructions;
+    auto load = loads.begin();
+    auto store = stores.begin();
+    for (gsl::index i = 0; i < static_cast<gsl::index>(code.size()); ++i) {
+        auto instruction = code[i];
+        if (load != loads.end() && i == load->first - code[load->first].Length) {
+            i = load->first;
+            instruction = code[i];
+            instruction.Type = NodeType::Variable;
+            instruction.Arity = 0;
+            instruction.Length = 0;
+            instruction.Coefficient = -1;
+            instruction.Value = 1;
+            instruction.Data = load->second;
+            instruction.SingleData = nullptr;
+            ++load;
+        } else if (instruction.Type == NodeType::Variable) {
+            instruction.Data += range.Start();
+            if (instruction.SingleData != nullptr) {
+                instruction.SingleData += range.Start();
+            }
+        }
+        while (store != stores.end() && store->first < i) {
+            ++store; // stores inside a loaded subtree
+        }
+        instruction.Output = store != stores.end() && store->first == i ? store->second : nullptr;
+        instructions.push_back(instruction);
+        hashes.push_back(plan.hashes[i]);
+    }
+}
+
+std::vector<Operon::Scalar> EvaluationPlan::GetCoefficients() const
+{
+    std::vector<Operon::Scalar> coefficients;
+    coefficients.reserve(coefficientsCount);
+    for (const auto& s : instructions) {
+        if (s.Coefficient >= 0) {
+            coefficients.push_back(s.Value);
+        }
+    }
+    return coefficients;
+}
+
+void EvaluationPlan::SetCoefficients(gsl::span<const Operon::Scalar> coefficients)
+{
+    Expects(coefficients.size() == coefficientsCount);
+    for (auto& s : instructions) {
+        if (s.Coefficient >= 0) {
+            s.Value = coefficients[s.Coefficient];
+        }
+    }
+}
+} // namespace Operon
@@ -0,0 +1,73 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+#include "core/subtreecache.hpp"
+
+namespace Operon {
+SubtreeCache::SubtreeCache(size_t capacityBytes, size_t minSubtreeLength)
+    : minLength(minSubtreeLength)
+    , cache(capacityBytes)
+    , admission(new std::atomic<Operon::Hash>[AdmissionSlots])
+{
+    for (size_t i = 0; i < AdmissionSlots; ++i) {
+        admission[i] = 0;
+    }
+}
+
+std::shared_ptr<const SubtreeCache::ValueType> SubtreeCache::Find(Operon::Hash hash, Range range)
+{
+    std::shared_ptr<const ValueType> values;
+    cache.Find(Key { hash, range.Start(), range.Size() }, [&](auto const& cached) { values = cached; });
+    return values;
+}
+
+bool SubtreeCache::Admit(Operon::Hash hash, Range range) noexcept
+{
+    auto key = KeyHash {}(Key { hash, range.Start(), range.Size() });
+    auto& slot = admission[key % AdmissionSlots];
+    if (slot.load(std::memory_order_relaxed) == key) {
+        return true;
+    }
+    slot.store(key, std::memory_order_relaxed);
+    return false;
+}
+
+void SubtreeCache::Insert(Operon::Hash hash, Range range, std::shared_ptr<const ValueType> values)
+{
+    cache.Insert(Key { hash, range.Start(), range.Size() }, std::move(values));
+}
+
+void SubtreeCache::Clear()
+{
+    cache.Clear();
+    for (size_t i = 0; i < AdmissionSlots; ++i) {
+        admission[i] = 0;
+    }
+}
+
+SubtreeCache::Statistics SubtreeCache::GetStatistics() const noexcept
+{
+    auto s = cache.GetStatistics();
+    return Statistics { s.Lookups, s.Hits, s.Insertions, s.Evictions, s.Entries, s.Cost };
+}
+
+void SubtreeCache::ResetStatistics() noexcept
+{
+    cache.ResetStatistics();
+}
+} // namespace Operon
@@ -18,10 +18,12 @@
  */
 
 #include <algorithm>
+#include <cmath>
 #include <exception>
 #include <execution>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <optional>
 #include <stack>
 #include <utility>
@@ -53,6 +55,293 @@ Tree& Tree::UpdateNodes()
     return *this;
 }
 
+Tree& Tree::UpdateNodeDepth()
+{
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        auto& s = nodes[i];
+        s.Depth = 1;
+        if (s.IsLeaf()) {
+            continue;
+        }
+        for (auto it = Children(i); it.HasNext(); ++it) {
+            s.Depth = std::max(s.Depth, it->Depth);
+        }
+        ++s.Depth;
+    }
+    return *this;
+}
+
+namespace {
+    // value of a function node whose children are the constants a (first child) and b (second child, if any)
+    Operon::Scalar Fold(NodeType type, Operon::Scalar a, Operon::Scalar b)
+    {
+        switch (type) {
+        case NodeType::Add:
+            return a + b;
+        case NodeType::Mul:
+            return a * b;
+        case NodeType::Sub:
+            return a - b;
+        case NodeType::Div:
+            return a / b;
+        case NodeType::Log:
+            return std::log(a);
+        case NodeType::Exp:
+            return std::exp(a);
+        case NodeType::Sin:
+            return std::sin(a);
+        case NodeType::Cos:
+            return std::cos(a);
+        case NodeType::Tan:
+            return std::tan(a);
+        case NodeType::Sqrt:
+            return std::sqrt(a);
+        case NodeType::Cbrt:
+            return std::cbrt(a);
+        case NodeType::Square:
+            return a * a;
+        default:
+            return std::numeric_limits<Operon::Scalar>::quiet_NaN();
+        }
+    }
+}
+
+// rewrites the tree bottom-up into an equivalent smaller tree, wherever the values involved are finite:
+// - functions of constants are folded into a constant (unless the result is not finite)
+// - additive and multiplicative identities are removed (x + 0, x - 0, x * 1, x / 1)
+// - annihilators are replaced by their result (x * 0 = 0, x - x = 0, and x / x = 1 for a non-constant x)
+// - constants are merged into variable weights (c * wx, wx / c, w1x + w2x, w1x - w2x, w1x / w2x)
+// - a constant is merged into a constant operand of a nested addition or multiplication (c1 + (c2 + x)), and the
+//   constant operands of an n-ary addition or multiplication are folded into one
+// finally the nested additions and multiplications are flattened into n-ary nodes (see Reduce)
+// hash values are not updated, the tree must be sorted again to obtain them
+Tree& Tree::Simplify()
+{
+    thread_local std::vector<Node> out;
+    thread_local std::vector<size_t> starts; // offsets in out of the simplified subtrees on the evaluation stack
+    thread_local std::vector<Node> rest;
+    out.clear();
+    starts.clear();
+
+    auto makeConstant = [](Node& n, Operon::Scalar value) {
+        n = Node(NodeType::Constant);
+        n.Value = value;
+    };
+    // sets the weight of a variable, which becomes the constant zero if its weight is zero
+    auto setWeight = [&](Node& n, Operon::Scalar weight) {
+        if (weight == 0) {
+            makeConstant(n, 0);
+        } else {
+            n.Value = weight;
+        }
+    };
+    auto isConstant = [&](size_t b, size_t e) { return e - b == 1 && out[b].IsConstant(); };
+    auto isVariable = [&](size_t b, size_t e) { return e - b == 1 && out[b].IsVariable(); };
+    auto equal = [&](size_t b1, size_t e1, size_t b2, size_t e2) {
+        return std::equal(out.begin() + b1, out.begin() + e1, out.begin() + b2, out.begin() + e2, [](const Node& x, const Node& y) {
+            return x.Type == y.Type && x.HashValue == y.HashValue && x.Arity == y.Arity && x.Value == y.Value;
+        });
+    };
+    // merges the constant c into a constant child of the subtree ending at e - 1, if it has the given type
+    auto mergeNested = [&](size_t b, size_t e, NodeType type, Operon::Scalar c) {
+        auto const& r = out[e - 1];
+        if (e - b < 3 || r.Type != type) {
+            return false;
+        }
+        for (size_t k = 0, j = e - 2; k < r.Arity; ++k, j -= out[j].Length + 1) {
+            if (out[j].IsConstant()) {
+                auto v = Fold(type, c, out[j].Value);
+                if (!std::isfinite(v)) {
+                    return false;
+                }
+                out[j].Value = v;
+                return true;
+            }
+        }
+        return false;
+    };
+
+    for (auto s : nodes) {
+        if (s.IsLeaf()) {
+            if (s.IsVariable()) {
+                setWeight(s, s.Value);
+            }
+            s.Length = 0;
+            starts.push_back(out.size());
+            out.push_back(s);
+            continue;
+        }
+
+        if (s.Arity == 1) {
+            auto b = starts.back();
+            if (isConstant(b, out.size())) {
+                if (auto v = Fold(s.Type, out[b].Value, 0); std::isfinite(v)) {
+                    out[b].Value = v;
+                    continue;
+                }
+            }
+            s.Length = out.size() - b;
+            out.push_back(s);
+            continue;
+        }
+
+        if (s.Arity > 2) {
+            // n-ary addition or multiplication (see Reduce): the constant children are folded into one
+            auto first = starts.size() - s.Arity; // the last child comes first
+            auto b = starts[first];
+            auto identity = s.IsAddition() ? Operon::Scalar { 0 } : Operon::Scalar { 1 };
+            auto c = identity;
+            size_t constants = 0;
+            for (auto k = first; k < starts.size(); ++k) {
+                auto e = k + 1 < starts.size() ? starts[k + 1] : out.size();
+                if (isConstant(starts[k], e)) {
+                    c = Fold(s.Type, c, out[starts[k]].Value);
+                    ++constants;
+                }
+            }
+            if (constants == 0 || !std::isfinite(c)) {
+                starts.resize(first + 1);
+                s.Length = out.size() - b;
+                out.push_back(s);
+                continue;
+            }
+            if (s.IsMultiplication() && c == 0) {
+                starts.resize(first + 1);
+                out.resize(b + 1);
+                makeConstant(out[b], 0);
+                continue;
+            }
+            rest.clear();
+            for (auto k = first; k < starts.size(); ++k) {
+                auto e = k + 1 < starts.size() ? starts[k + 1] : out.size();
+                if (!isConstant(starts[k], e)) {
+                    rest.insert(rest.end(), out.begin() + starts[k], out.begin() + e);
+                }
+            }
+            size_t arity = s.Arity - constants;
+            starts.resize(first + 1);
+            out.resize(b);
+            if (c != identity || arity == 0) {
+                out.emplace_back();
+                makeConstant(out.back(), c);
+                ++arity;
+            }
+            out.insert(out.end(), rest.begin(), rest.end());
+            if (arity > 1) {
+                s.Arity = arity;
+                s.Length = out.size() - b;
+                out.push_back(s);
+            }
+            continue;
+        }
+
+        // the first child x spans [b0, e0) and the second child y spans [b1, b0)
+        auto b0 = starts.back();
+        starts.pop_back();
+        auto b1 = starts.back(); // start of the result
+        auto e0 = out.size();
+        auto& x = out[b0];
+        auto& y = out[b1];
+        bool cx = isConstant(b0, e0);
+        bool cy = isConstant(b1, b0);
+        bool vx = isVariable(b0, e0);
+        bool vy = isVariable(b1, b0);
+        bool same = vx && vy && x.HashValue == y.HashValue;
+
+        auto keepFirst = [&]() { out.erase(out.begin() + b1, out.begin() + b0); };
+        auto keepSecond = [&]() { out.resize(b0); };
+        auto replace = [&](Operon::Scalar value) {
+            out.resize(b1 + 1);
+            makeConstant(out[b1], value);
+        };
+
+        if (cx && cy) {
+            if (auto v = Fold(s.Type, x.Value, y.Value); std::isfinite(v)) {
+                replace(v);
+                continue;
+            }
+        }
+
+        switch (s.Type) {
+        case NodeType::Add: {
+            if (cx && x.Value == 0) {
+                keepSecond();
+            } else if (cy && y.Value == 0) {
+                keepFirst();
+            } else if (same) {
+                setWeight(y, x.Value + y.Value);
+                keepSecond();
+            } else if (cx && mergeNested(b1, b0, NodeType::Add, x.Value)) {
+                keepSecond();
+            } else if (cy && mergeNested(b0, e0, NodeType::Add, y.Value)) {
+                keepFirst();
+            } else {
+                break;
+            }
+            continue;
+        }
+        case NodeType::Mul: {
+            if ((cx && x.Value == 0) || (cy && y.Value == 0)) {
+                replace(0);
+            } else if (cx && x.Value == 1) {
+                keepSecond();
+            } else if (cy && y.Value == 1) {
+                keepFirst();
+            } else if (cx && vy) {
+                setWeight(y, x.Value * y.Value);
+                keepSecond();
+            } else if (cy && vx) {
+                setWeight(x, x.Value * y.Value);
+                keepFirst();
+            } else if (cx && mergeNested(b1, b0, NodeType::Mul, x.Value)) {
+                keepSecond();
+            } else if (cy && mergeNested(b0, e0, NodeType::Mul, y.Value)) {
+                keepFirst();
+            } else {
+                break;
+            }
+            continue;
+        }
+        case NodeType::Sub: {
+            if (cy && y.Value == 0) {
+                keepFirst();
+            } else if (same) {
+                setWeight(x, x.Value - y.Value);
+                keepFirst();
+            } else if (equal(b0, e0, b1, b0)) {
+                replace(0);
+            } else {
+                break;
+            }
+            continue;
+        }
+        case NodeType::Div: {
+            if (cy && y.Value == 1) {
+                keepFirst();
+            } else if (vx && cy && y.Value != 0) {
+                setWeight(x, x.Value / y.Value);
+                keepFirst();
+            } else if (same && y.Value != 0) {
+                replace(x.Value / y.Value);
+            } else if (!(cx && cy) && equal(b0, e0, b1, b0)) {
+                replace(1);
+            } else {
+                break;
+            }
+            continue;
+        }
+        default:
+            break;
+        }
+
+        s.Length = out.size() - b1;
+        out.push_back(s);
+    }
+
+    nodes.assign(out.begin(), out.end());
+    return this->UpdateNodes().Reduce();
+}
+
 Tree& Tree::Reduce()
 {
     bool reduced = false;
@@ -63,7 +352,7 @@ Tree& Tree::Reduce()
         }
 
         for (auto it = Children(i); it.HasNext(); ++it) {
-            if (s.HashValue == it->HashValue) {
+            if (s.Type == it->Type) {
                 it->IsEnabled = false;
                 s.Arity += it->Arity - 1;
                 reduced = true;
@@ -80,20 +369,19 @@ Tree& Tree::Reduce()
     return this->UpdateNodes();
 }
 
-Tree& Tree::Sort(Operon::HashMode mode)
-{
-    // preallocate memory to reduce fragmentation
-    std::vector<Node> sorted;
-    sorted.reserve(nodes.size());
-
-    std::vector<int> children;
-    children.reserve(nodes.size());
-
-    std::vector<Operon::Hash> hashes;
-    hashes.reserve(nodes.size());
+namespace {
+    // buffers reused by the sorting of the nodes
+    struct SortState {
+        std::vector<Node> sorted;
+        std::vector<int> children;
+        std::vector<Operon::Hash> hashes;
+    };
 
-    auto start = nodes.begin();
-    for (size_t i = 0; i < nodes.size(); ++i) {
+    // sorts the children of node i if it is commutative, then calculates its hash value from the calculated hash
+    // values of its descendants, which must be up to date
+    void SortNode(Tree& tree, gsl::index i, Operon::HashMode mode, SortState& state)
+    {
+        auto& nodes = tree.Nodes();
         auto& s = nodes[i];
 
         if (s.IsLeaf()) {
@@ -103,9 +391,11 @@ Tree& Tree::Sort(Operon::HashMode mode)
             } else if (mode == Operon::HashMode::Relaxed) {
                 s.CalculatedHashValue = s.HashValue;
             }
-            continue;
+            return;
         }
 
+        auto& [sorted, children, hashes] = state;
+        auto start = nodes.begin();
         auto arity = s.Arity;
         auto size = s.Length;
         auto sBegin = start + i - size;
@@ -115,7 +405,7 @@ Tree& Tree::Sort(Operon::HashMode mode)
             if (arity == size) {
                 std::sort(sBegin, sEnd);
             } else {
-                for (auto it = Children(i); it.HasNext(); ++it) {
+                for (auto it = tree.Children(i); it.HasNext(); ++it) {
                     children.push_back(it.Index());
                 }
                 std::sort(children.begin(), children.end(), [&](int a, int b) { return nodes[a] < nodes[b]; }); // sort child indices
@@ -134,6 +424,30 @@ Tree& Tree::Sort(Operon::HashMode mode)
         s.CalculatedHashValue = xxh::xxhash3<Operon::HashBits>(hashes);
         hashes.clear();
     }
+}
+
+Tree& Tree::Sort(Operon::HashMode mode)
+{
+    thread_local SortState state;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        SortNode(*this, i, mode, state);
+    }
+    return this->UpdateNodes();
+}
+
+Tree& Tree::Sort(gsl::index i, Operon::HashMode mode)
+{
+    thread_local SortState state;
+    // the node's own index does not change when its children are sorted, so the parent indices remain valid
+    // while walking up; they are updated once at the end
+    gsl::index root = nodes.size() - 1;
+    for (;;) {
+        SortNode(*this, i, mode, state);
+        if (i == root) {
+            break;
+        }
+        i = nodes[i].Parent;
+    }
     return this->UpdateNodes();
 }
 
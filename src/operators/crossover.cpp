@@ -25,7 +25,8 @@ static gsl::index SelectRandomBranch(Operon::Random& random, const Tree& tree, d
     auto selectInternalNode = std::bernoulli_distribution(internalProb)(random);
     const auto& nodes = tree.Nodes();
     // create a vector of indices where leafs are in the front and internal nodes in the back
-    std::vector<gsl::index> indices(nodes.size());
+    thread_local std::vector<gsl::index> indices;
+    indices.resize(nodes.size());
     size_t head = 0;
     size_t tail = nodes.size() - 1;
     for (size_t i = 0; i < nodes.size(); ++i) {
@@ -66,8 +67,19 @@ std::pair<gsl::index, gsl::index> SubtreeCrossover::FindCompatibleSwapLocations(
 }
 
 Tree SubtreeCrossover::operator()(Operon::Random& random, const Tree& lhs, const Tree& rhs) const
+{
+    Tree child;
+    (*this)(random, lhs, rhs, child);
+    return child;
+}
+
+void SubtreeCrossover::operator()(Operon::Random& random, const Tree& lhs, const Tree& rhs, Tree& child) const
 {
     auto [i, j] = FindCompatibleSwapLocations(random, lhs, rhs);
-    return Cross(lhs, rhs, i, j);
+    Cross(lhs, rhs, i, j, child);
+    if (hashMode) {
+        // only the inserted subtree root and its ancestors need to be sorted and rehashed
+        child.Sort(i - lhs[i].Length + rhs[j].Length, *hashMode);
+    }
 }
 }
@@ -37,6 +37,9 @@ Tree OnePointMutation::operator()(Operon::Random& random, Tree tree) const
     std::normal_distribution<double> normalReal(0, 1);
     tree[i].Value += normalReal(random);
 
+    if (hashMode) {
+        tree.Sort(i, *hashMode);
+    }
     return tree;
 }
 
@@ -48,6 +51,9 @@ Tree MultiPointMutation::operator()(Operon::Random& random, Tree tree) const
             node.Value += normalReal(random);
         }
     }
+    if (hashMode) {
+        tree.Sort(*hashMode);
+    }
     return tree;
 }
 
@@ -62,19 +68,28 @@ Tree ChangeVariableMutation::operator()(Operon::Random& random, Tree tree) const
 {
     auto& nodes = tree.Nodes();
 
-    auto leafCount = std::count_if(nodes.begin(), nodes.end(), [](const Node& node) { return node.IsLeaf(); });
-    std::uniform_int_distribution<gsl::index> uniformInt(1, leafCount);
+    // only variables are changed: a constant given a variable hash would be hashed (and sorted) like a variable
+    auto varCount = std::count_if(nodes.begin(), nodes.end(), [](const Node& node) { return node.IsVariable(); });
+
+    if (varCount == 0) {
+        return tree;
+    }
+
+    std::uniform_int_distribution<gsl::index> uniformInt(1, varCount);
     auto index = uniformInt(random);
 
     size_t i = 0;
     for (; i < nodes.size(); ++i) {
-        if (nodes[i].IsLeaf() && --index == 0)
+        if (nodes[i].IsVariable() && --index == 0)
             break;
     }
 
     std::uniform_int_distribution<gsl::index> normalInt(0, variables.size() - 1);
     tree[i].HashValue = tree[i].CalculatedHashValue = variables[normalInt(random)].Hash;
 
+    if (hashMode) {
+        tree.Sort(i, *hashMode);
+    }
     return tree;
 }
 
@@ -94,7 +109,14 @@ Tree ChangeFunctionMutation::operator()(Operon::Random& random, Tree tree) const
         if (!nodes[i].IsLeaf() && --index == 0)
             break;
     }
-    nodes[i].Type = grammar.SampleRandomSymbol(random, nodes[i].Arity, nodes[i].Arity).Type;
+    // only the functions of the same arity are compatible (an n-ary node may only become another n-ary node)
+    if (auto node = grammar.SampleRandomSymbol(random, nodes[i].Arity, nodes[i].Arity); node.Arity == nodes[i].Arity) {
+        nodes[i].Type = node.Type;
+        nodes[i].HashValue = nodes[i].CalculatedHashValue = node.HashValue;
+        if (hashMode) {
+            tree.Sort(i, *hashMode);
+        }
+    }
     return tree;
 }
 
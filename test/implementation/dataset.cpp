@@ -0,0 +1,457 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#include <catch2/catch.hpp>
+#include <cstdio>
+#include <fstream>
+
+#include "core/dataset.hpp"
+#include "core/eval.hpp"
+#include "core/metrics.hpp"
+#include "operators/creator.hpp"
+
+namespace Operon {
+namespace Test {
+
+TEST_CASE("Binary dataset format", "[implementation]")
+{
+    auto csv = Dataset("../data/Poly-10.csv", true);
+    auto path = std::string("poly10.bin");
+    csv.Save(path);
+
+    auto bin = Dataset(path);
+    REQUIRE(bin.IsMapped());
+    REQUIRE(!csv.IsMapped());
+    REQUIRE(bin.Rows() == csv.Rows());
+    REQUIRE(bin.Cols() == csv.Cols());
+
+    SECTION("Variables and values")
+    {
+        for (auto const& v : csv.Variables()) {
+            REQUIRE(bin.GetHashValue(v.Name) == v.Hash);
+            REQUIRE(bin.GetIndex(v.Hash) == v.Index);
+            auto x = csv.GetValues(v.Hash);
+            auto y = bin.GetValues(v.Hash);
+            REQUIRE(std::equal(x.begin(), x.end(), y.begin(), y.end()));
+            // columns start at cache line boundaries
+            REQUIRE(reinterpret_cast<uintptr_t>(y.data()) % 64 == 0);
+        }
+    }
+
+    SECTION("Copies share the mapping")
+    {
+        auto copy = bin;
+        REQUIRE(copy.IsMapped());
+        REQUIRE(copy.GetValues(gsl::index { 0 }).data() == bin.GetValues(gsl::index { 0 }).data());
+
+        // modifications work on a private copy
+        copy.Standardize(0, Range { 0, 250 });
+        REQUIRE(!copy.IsMapped());
+        REQUIRE(copy.GetValues(gsl::index { 0 }).data() != bin.GetValues(gsl::index { 0 }).data());
+        REQUIRE(bin.GetValues(gsl::index { 0 })[0] == csv.GetValues(gsl::index { 0 })[0]);
+    }
+
+    SECTION("Evaluation")
+    {
+        std::vector<Variable> inputs;
+        std::copy_if(csv.Variables().begin(), csv.Variables().end(), std::back_inserter(inputs), [](auto const& v) { return v.Name != "Y"; });
+
+        Operon::Random random(1234);
+        Grammar grammar;
+        std::uniform_int_distribution<size_t> sizeDistribution(1, 50);
+        auto creator = BalancedTreeCreator { sizeDistribution, 10, 50 };
+        auto range = Range { 0, csv.Rows() };
+
+        for (int i = 0; i < 100; ++i) {
+            auto tree = creator(random, grammar, inputs);
+            auto x = Evaluate<Operon::Scalar>(tree, csv, range);
+            auto y = Evaluate<Operon::Scalar>(tree, bin, range);
+            REQUIRE(std::equal(x.begin(), x.end(), y.begin(), y.end(), [](auto a, auto b) { return a == b || (std::isnan(a) && std::isnan(b)); }));
+        }
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("CSV parsing", "[implementation]")
+{
+    auto path = std::string("parse.csv");
+    auto write = [&](std::string const& content) {
+        std::ofstream out(path, std::ios::binary);
+        out << content;
+    };
+
+    SECTION("Header and formatting")
+    {
+        write("\xEF\xBB\xBF\"a\", b ,Y\r\n1,+2.5,-3e-2\r\n\r\n 4 ,\"5\",6E+1\r\n");
+        auto ds = Dataset(path, true);
+        REQUIRE(ds.Rows() == 2);
+        REQUIRE(ds.Cols() == 3);
+        auto a = ds.GetValues("a");
+        auto b = ds.GetValues("b");
+        auto y = ds.GetValues("Y");
+        REQUIRE(a[0] == 1);
+        REQUIRE(a[1] == 4);
+        REQUIRE(b[0] == 2.5);
+        REQUIRE(b[1] == 5);
+        REQUIRE(y[0] == -3e-2);
+        REQUIRE(y[1] == 60);
+    }
+
+    SECTION("No header")
+    {
+        write("1,2,3\n4,5,6");
+        auto ds = Dataset(path, false);
+        REQUIRE(ds.Rows() == 2);
+        REQUIRE(ds.GetValues("X1")[1] == 4);
+        REQUIRE(ds.GetValues("Y")[0] == 3);
+    }
+
+    SECTION("Invalid input")
+    {
+        write("a,b\n1,2\n3\n");
+        REQUIRE_THROWS_AS(Dataset(path, true), std::runtime_error);
+        write("a,b\n1,x\n");
+        REQUIRE_THROWS_AS(Dataset(path, true), std::runtime_error);
+    }
+
+    SECTION("Quoted fields")
+    {
+        // commas, doubled quotes and line breaks inside quoted header fields
+        write("\"x, in \"\"m\"\"\",\"multi\r\nline\",Y\r\n1,\" 2 \",3\r\n4,5,\"6\"\r\n");
+        auto ds = Dataset(path, true);
+        REQUIRE(ds.Rows() == 2);
+        REQUIRE(ds.Cols() == 3);
+        auto x = ds.GetValues("x, in \"m\"");
+        auto m = ds.GetValues("multi\r\nline");
+        REQUIRE(x[1] == 4);
+        REQUIRE(m[0] == 2);
+        REQUIRE(ds.GetValues("Y")[1] == 6);
+
+        // quoted values which are not numbers, unterminated quotes and text after a closing quote are rejected
+        write("a,b\n1,\"2,5\"\n");
+        REQUIRE_THROWS_AS(Dataset(path, true), std::runtime_error);
+        write("a,b\n1,\"2\n3\"\n");
+        REQUIRE_THROWS_AS(Dataset(path, true), std::runtime_error);
+        write("a,b\n1,\"2\n");
+        REQUIRE_THROWS_AS(Dataset(path, true), std::runtime_error);
+        write("a,b\n1,\"2\"3\n");
+        REQUIRE_THROWS_AS(Dataset(path, true), std::runtime_error);
+    }
+
+    SECTION("Multiple chunks")
+    {
+        // large enough to be split into several chunks, the values must match strtod
+        auto csv = Dataset("../data/Friedman-I.csv", true);
+        REQUIRE(csv.Rows() == 10000);
+        std::ifstream in("../data/Friedman-I.csv");
+        std::string line;
+        std::getline(in, line);
+        std::vector<gsl::span<const Operon::Scalar>> columns;
+        for (size_t j = 1; j < csv.Cols(); ++j) {
+            columns.push_back(csv.GetValues(fmt::format("X{}", j)));
+        }
+        columns.push_back(csv.GetValues("Y"));
+        for (size_t i = 0; std::getline(in, line); ++i) {
+            auto p = line.c_str();
+            for (auto const& column : columns) {
+                char* end;
+                REQUIRE(column[i] == std::strtod(p, &end));
+                p = end + 1;
+            }
+        }
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("Single precision cache", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto cached = ds;
+    REQUIRE(!cached.HasSinglePrecision());
+    cached.CacheSinglePrecision();
+    REQUIRE(cached.HasSinglePrecision());
+    REQUIRE(!ds.HasSinglePrecision());
+
+    auto check = [&](Dataset const& d) {
+        for (size_t j = 0; j < d.Cols(); ++j) {
+            auto x = d.GetValues(static_cast<gsl::index>(j));
+            auto y = d.GetSingleValues(static_cast<gsl::index>(j));
+            REQUIRE(y.size() == x.size());
+            for (size_t i = 0; i < x.size(); ++i) {
+                REQUIRE(y[i] == static_cast<float>(x[i]));
+            }
+        }
+    };
+    check(cached);
+
+    SECTION("Evaluation")
+    {
+        std::vector<Variable> inputs;
+        std::copy_if(ds.Variables().begin(), ds.Variables().end(), std::back_inserter(inputs), [](auto const& v) { return v.Name != "Y"; });
+
+        Operon::Random random(1234);
+        Grammar grammar;
+        grammar.SetConfig(Grammar::Full);
+        std::uniform_int_distribution<size_t> sizeDistribution(1, 50);
+        auto creator = BalancedTreeCreator { sizeDistribution, 10, 50 };
+        auto range = Range { 0, ds.Rows() };
+
+        for (int i = 0; i < 100; ++i) {
+            auto tree = creator(random, grammar, inputs);
+            EvaluationPlan plan(tree, cached);
+            REQUIRE(std::all_of(plan.Instructions().begin(), plan.Instructions().end(), [](auto const& s) { return (s.Type == NodeType::Variable) == (s.SingleData != nullptr); }));
+            auto x = Evaluate<float>(tree, ds, range);
+            auto y = Evaluate<float>(plan, range);
+            REQUIRE(std::equal(x.begin(), x.end(), y.begin(), y.end(), [](auto a, auto b) { return a == b || (std::isnan(a) && std::isnan(b)); }));
+        }
+    }
+
+    SECTION("Modifications and subsets")
+    {
+        cached.Standardize(0, Range { 0, 250 });
+        REQUIRE(cached.HasSinglePrecision());
+        check(cached);
+
+        std::vector<gsl::index> rows { 1, 3, 5 };
+        auto subset = cached.Subset(rows);
+        REQUIRE(subset.HasSinglePrecision());
+        check(subset);
+
+        cached.ReleaseSinglePrecision();
+        REQUIRE(cached.GetSingleValues(gsl::index { 0 }).empty());
+    }
+}
+
+TEST_CASE("Variable lookup", "[implementation]")
+{
+    SECTION("Loaded dataset")
+    {
+        auto ds = Dataset("../data/Friedman-I.csv", true);
+        for (auto const& v : ds.Variables()) {
+            REQUIRE(ds.GetIndex(v.Hash) == v.Index);
+            REQUIRE(ds.GetName(v.Hash) == v.Name);
+            REQUIRE(ds.GetHashValue(v.Name) == v.Hash);
+            REQUIRE(ds.GetValues(v.Hash).data() == ds.GetValues(v.Name).data());
+            REQUIRE(ds.GetValues(v.Hash).data() == ds.GetValues(v.Index).data());
+        }
+
+        // the lookup tables survive copies and moves
+        auto copy = ds;
+        auto moved = std::move(copy);
+        for (auto const& v : moved.Variables()) {
+            REQUIRE(moved.GetIndex(v.Hash) == v.Index);
+            REQUIRE(moved.GetHashValue(v.Name) == v.Hash);
+        }
+    }
+
+    SECTION("Unsorted variables with colliding slots")
+    {
+        // hashes with identical low bits land in the same slot and must be resolved by probing
+        std::vector<Variable> variables {
+            { "c", Operon::Hash { 0x300 }, 0 },
+            { "a", Operon::Hash { 0x100 }, 1 },
+            { "b", Operon::Hash { 0x200 }, 2 },
+        };
+        std::vector<std::vector<Operon::Scalar>> values { { 0, 0 }, { 1, 1 }, { 2, 2 } };
+        auto ds = Dataset(variables, values);
+        for (auto const& v : variables) {
+            REQUIRE(ds.GetIndex(v.Hash) == v.Index);
+            REQUIRE(ds.GetName(v.Hash) == v.Name);
+            REQUIRE(ds.GetValues(v.Hash)[0] == v.Index);
+            REQUIRE(ds.GetValues(v.Name)[1] == v.Index);
+        }
+    }
+}
+
+TEST_CASE("Dataset stream", "[implementation]")
+{
+    auto ds = Dataset("../data/Friedman-I.csv", true);
+    auto path = std::string("stream.bin");
+    ds.Save(path);
+
+    // a block size which does not divide the number of rows
+    DatasetStream stream(path, 777);
+    REQUIRE(stream.Rows() == ds.Rows());
+    REQUIRE(stream.Cols() == ds.Cols());
+    REQUIRE(stream.BlockRows() == 777);
+
+    SECTION("Blocks")
+    {
+        auto range = Range { 123, 9000 };
+        size_t total = 0;
+        stream.ForEach(range, [&](Dataset const& block, Range blockRange, size_t offset) {
+            REQUIRE(offset == total);
+            for (auto const& v : ds.Variables()) {
+                REQUIRE(block.GetHashValue(v.Name) == v.Hash);
+                auto x = ds.GetValues(v.Hash).subspan(range.Start() + offset, blockRange.Size());
+                auto y = block.GetValues(v.Hash).subspan(blockRange.Start(), blockRange.Size());
+                REQUIRE(std::equal(x.begin(), x.end(), y.begin(), y.end()));
+            }
+            total += blockRange.Size();
+        });
+        REQUIRE(total == range.Size());
+    }
+
+    SECTION("Metrics")
+    {
+        std::vector<Variable> inputs;
+        std::copy_if(ds.Variables().begin(), ds.Variables().end(), std::back_inserter(inputs), [](auto const& v) { return v.Name != "Y"; });
+
+        Operon::Random random(1234);
+        Grammar grammar;
+        // without division, so that no values need to be replaced (which is done per block when streaming)
+        grammar.SetConfig(Grammar::Arithmetic & ~NodeType::Div);
+        std::uniform_int_distribution<size_t> sizeDistribution(1, 50);
+        auto creator = BalancedTreeCreator { sizeDistribution, 10, 50 };
+        auto range = Range { 0, ds.Rows() };
+        auto targetValues = ds.GetValues("Y");
+
+        for (int i = 0; i < 20; ++i) {
+            auto tree = creator(random, grammar, inputs);
+            auto estimated = Evaluate<Operon::Scalar>(tree, ds, range);
+            REQUIRE(RSquared(tree, stream, range, "Y") == Approx(RSquared(estimated, targetValues)).epsilon(1e-9));
+            REQUIRE(NormalizedMeanSquaredError(tree, stream, range, "Y") == Approx(NormalizedMeanSquaredError(estimated, targetValues)).epsilon(1e-9));
+        }
+    }
+
+    SECTION("Missing targets")
+    {
+        // every tenth target is missing: the rows are left out of the nmse, in memory and when streaming
+        std::vector<Variable> variables(ds.Variables().begin(), ds.Variables().end());
+        std::vector<std::vector<Operon::Scalar>> values(ds.Cols());
+        for (auto const& v : variables) {
+            auto x = ds.GetValues(v.Hash);
+            values[v.Index].assign(x.begin(), x.end());
+            if (v.Name == "Y") {
+                for (size_t i = 0; i < values[v.Index].size(); i += 10) {
+                    values[v.Index][i] = std::numeric_limits<Operon::Scalar>::quiet_NaN();
+                }
+            }
+        }
+        auto missing = Dataset(variables, values);
+        auto missingPath = std::string("stream-missing.bin");
+        missing.Save(missingPath);
+        DatasetStream missingStream(missingPath, 777);
+
+        auto x1 = Node(NodeType::Variable, ds.GetHashValue("X1"));
+        x1.Value = 2;
+        auto tree = Tree { x1 };
+        tree.UpdateNodes();
+        auto range = Range { 0, ds.Rows() };
+        auto estimated = Evaluate<Operon::Scalar>(tree, missing, range);
+        auto nmse = NormalizedMeanSquaredError(estimated, missing.GetValues("Y"));
+        REQUIRE(std::isfinite(nmse));
+        REQUIRE(NormalizedMeanSquaredError(tree, missingStream, range, "Y") == Approx(nmse).epsilon(1e-9));
+        std::remove(missingPath.c_str());
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("Dataset preprocessing", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    std::vector<gsl::index> columns(ds.Cols());
+    std::iota(columns.begin(), columns.end(), gsl::index { 0 });
+
+    SECTION("Shuffle")
+    {
+        auto shuffled = ds;
+        Operon::Random random(1234);
+        shuffled.Shuffle(random);
+
+        // the permutation matrix product used previously (row i moves to perm[i])
+        Operon::Random reference(1234);
+        Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic> perm(ds.Rows());
+        perm.setIdentity();
+        std::shuffle(perm.indices().data(), perm.indices().data() + perm.indices().size(), reference);
+        Dataset::MatrixType expected = perm * ds.Values().matrix();
+        REQUIRE((shuffled.Values() == expected).all());
+    }
+
+    SECTION("Standardize")
+    {
+        auto range = Range { 0, 250 };
+        auto expected = ds;
+        auto actual = ds;
+        for (auto c : columns) {
+            expected.Standardize(c, range);
+        }
+        actual.Standardize(columns, range);
+        REQUIRE((expected.Values() == actual.Values()).all());
+
+        for (auto c : columns) {
+            auto x = actual.GetValues(c).subspan(range.Start(), range.Size());
+            MeanVarianceCalculator calc;
+            calc.Add(x);
+            REQUIRE(std::abs(calc.Mean()) < 1e-12);
+            REQUIRE(calc.StandardDeviation() == Approx(1.0));
+        }
+    }
+
+    SECTION("Constant column")
+    {
+        auto vars = ds.Variables();
+        std::vector<std::vector<Operon::Scalar>> vals;
+        for (size_t i = 0; i < vars.size(); ++i) {
+            auto x = ds.GetValues(i);
+            vals.emplace_back(x.begin(), x.end());
+        }
+        std::fill(vals[0].begin(), vals[0].end(), 3.0);
+        auto constant = Dataset(std::vector<Variable>(vars.begin(), vars.end()), vals);
+        auto range = Range { 0, 250 };
+        for (auto standardize : { false, true }) {
+            auto scaled = constant;
+            if (standardize) {
+                scaled.Standardize(columns, range);
+            } else {
+                scaled.Normalize(columns, range);
+            }
+            auto x = scaled.GetValues(0);
+            REQUIRE(std::all_of(x.begin(), x.end(), [](auto v) { return v == 0; }));
+            REQUIRE(scaled.GetScaling(0).Scale == 1);
+            REQUIRE(scaled.GetScaling(0).Offset == 3);
+        }
+    }
+
+    SECTION("Scaling parameters")
+    {
+        auto scaled = ds;
+        REQUIRE(scaled.GetScaling(0).Scale == 1);
+        // the whole range is allowed, and repeated scaling composes
+        scaled.Normalize(columns, Range { 0, ds.Rows() });
+        scaled.Standardize(columns, Range { 100, 200 });
+        for (auto c : columns) {
+            auto scaling = scaled.GetScaling(c);
+            auto x = ds.GetValues(c);
+            auto y = scaled.GetValues(c);
+            for (size_t i = 0; i < x.size(); ++i) {
+                REQUIRE(scaling.Invert(y[i]) == Approx(x[i]));
+                REQUIRE(scaling.Apply(x[i]) == Approx(y[i]).margin(1e-12));
+            }
+        }
+        auto subset = scaled.Subset(std::vector<gsl::index> { 1, 2 });
+        REQUIRE(subset.GetScaling(3).Offset == scaled.GetScaling(3).Offset);
+    }
+}
+
+} // namespace Test
+} // namespace Operon
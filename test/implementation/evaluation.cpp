@@ -20,8 +20,13 @@
 #include "core/dataset.hpp"
 #include "core/eval.hpp"
 #include "core/format.hpp"
+#include "core/levenbergmarquardt.hpp"
 #include "core/stats.hpp"
 #include "core/metrics.hpp"
+#include "operators/creator.hpp"
+#include "operators/crossover.hpp"
+#include "operators/evaluator.hpp"
+#include "operators/mutation.hpp"
 
 #include <catch2/catch.hpp>
 
@@ -140,6 +145,316 @@ TEST_CASE("Evaluation correctness", "[implementation]")
     }
 }
 
+TEST_CASE("Evaluation plan", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+    auto range = Range { 0, 250 };
+
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [](const auto& v) { return v.Name != "Y"; });
+
+    Operon::Random random(1234);
+    Grammar grammar;
+    grammar.SetConfig(Grammar::Full);
+    std::uniform_int_distribution<size_t> sizeDistribution(1, 50);
+    auto creator = BalancedTreeCreator { sizeDistribution, 10, 50 };
+
+    EvaluationPlan reused;
+    for (int i = 0; i < 100; ++i) {
+        auto tree = creator(random, grammar, inputs);
+        EvaluationPlan plan(tree, ds);
+        REQUIRE(plan.Length() == tree.Length());
+
+        // recompiling a plan in place should be equivalent to constructing a new one
+        reused.Compile(tree, ds);
+        REQUIRE(reused.Length() == plan.Length());
+        REQUIRE(reused.BufferSize() == plan.BufferSize());
+        REQUIRE(plan.CoefficientsCount() == tree.CoefficientsCount());
+
+        // evaluating with explicit parameters should match the coefficients stored in the plan
+        auto coef = tree.GetCoefficients();
+        auto expected = Evaluate<Operon::Scalar>(plan, range);
+        auto actual = Evaluate<Operon::Scalar>(plan, range, coef.data());
+        REQUIRE(std::equal(expected.begin(), expected.end(), actual.begin()));
+        auto recompiledInPlace = Evaluate<Operon::Scalar>(reused, range);
+        REQUIRE(std::equal(expected.begin(), expected.end(), recompiledInPlace.begin()));
+
+        // updating the coefficients of the plan should have the same effect as recompiling the modified tree
+        std::transform(coef.begin(), coef.end(), coef.begin(), [](auto v) { return v * 0.5; });
+        plan.SetCoefficients(coef);
+        tree.SetCoefficients(coef);
+        auto updated = Evaluate<Operon::Scalar>(plan, range);
+        auto recompiled = Evaluate<Operon::Scalar>(tree, ds, range);
+        REQUIRE(std::equal(updated.begin(), updated.end(), recompiled.begin()));
+
+        // the stack layout reuses buffer columns but must produce the same values as the linear layout
+        EvaluationPlan linear(tree, ds, BufferLayout::Linear);
+        REQUIRE(linear.BufferSize() == tree.Length());
+        REQUIRE(plan.BufferSize() <= linear.BufferSize());
+        auto reference = Evaluate<Operon::Scalar>(linear, range);
+        REQUIRE(std::equal(updated.begin(), updated.end(), reference.begin()));
+    }
+}
+
+TEST_CASE("Vectorized unary primitives", "[implementation]")
+{
+    // compares the vectorized kernels with the standard library over a range of arguments
+    auto check = [](auto tolerance, auto&& op, auto&& ref) {
+        using T = decltype(tolerance);
+        Eigen::Array<T, Eigen::Dynamic, 1> x(20003);
+        x.head(20000).setLinSpaced(T(-100), T(100));
+        x.tail(3) << T(0), T(1e-30), T(1e8);
+
+        Eigen::Array<T, Eigen::Dynamic, 1> y = x.unaryExpr(op);
+        for (gsl::index i = 0; i < x.size(); ++i) {
+            auto expected = ref(x(i));
+            REQUIRE(std::abs(y(i) - expected) <= tolerance * std::max(T(1), std::abs(expected)));
+        }
+    };
+
+    SECTION("float")
+    {
+        check(1e-5f, Math::Sin<float>(), [](float v) { return std::sin(v); });
+        check(1e-5f, Math::Cos<float>(), [](float v) { return std::cos(v); });
+        check(1e-3f, Math::Tan<float>(), [](float v) { return std::tan(v); });
+        check(1e-6f, Math::Cbrt<float>(), [](float v) { return std::cbrt(v); });
+    }
+
+    SECTION("double")
+    {
+        check(1e-12, Math::Sin<double>(), [](double v) { return std::sin(v); });
+        check(1e-12, Math::Cos<double>(), [](double v) { return std::cos(v); });
+        check(1e-10, Math::Tan<double>(), [](double v) { return std::tan(v); });
+        check(1e-14, Math::Cbrt<double>(), [](double v) { return std::cbrt(v); });
+    }
+}
+
+TEST_CASE("Evaluation batch size", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+    auto range = Range { 0, 250 }; // not a multiple of any batch size
+
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [](const auto& v) { return v.Name != "Y"; });
+
+    Operon::Random random(1234);
+    Grammar grammar;
+    grammar.SetConfig(Grammar::Full);
+    std::uniform_int_distribution<size_t> sizeDistribution(1, 100);
+    auto creator = BalancedTreeCreator { sizeDistribution, 20, 100 };
+
+    Operon::Vector<Operon::Scalar> actual(range.Size());
+    for (int i = 0; i < 100; ++i) {
+        auto tree = creator(random, grammar, inputs);
+        EvaluationPlan plan(tree, ds);
+        auto expected = Evaluate<Operon::Scalar>(plan, range);
+
+        auto check = [&](auto batchSize) {
+            constexpr gsl::index S = decltype(batchSize)::value;
+            Evaluate<S>(plan, range, static_cast<Operon::Scalar const*>(nullptr), gsl::span<Operon::Scalar>(actual));
+            REQUIRE(std::equal(expected.begin(), expected.end(), actual.begin()));
+        };
+        check(std::integral_constant<gsl::index, 16> {});
+        check(std::integral_constant<gsl::index, 32> {});
+        check(std::integral_constant<gsl::index, 128> {});
+        check(std::integral_constant<gsl::index, 256> {});
+    }
+
+    // the dispatch should use the batch size stored in the table
+    auto tree = creator(random, grammar, inputs);
+    auto expected = Evaluate<Operon::Scalar>(tree, ds, range);
+    for (auto s : BatchSizes) {
+        BatchSizeTable<Operon::Scalar>::Set(BatchSizeTable<Operon::Scalar>::Bucket(tree.Length()), s);
+        REQUIRE(BatchSizeTable<Operon::Scalar>::Get(tree.Length()) == s);
+        auto values = Evaluate<Operon::Scalar>(tree, ds, range);
+        REQUIRE(std::equal(expected.begin(), expected.end(), values.begin()));
+    }
+    BatchSizeTable<Operon::Scalar>::Reset();
+}
+
+TEST_CASE("N-ary evaluation", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+    auto range = Range { 0, 250 };
+
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [](const auto& v) { return v.Name != "Y"; });
+
+    auto variable = [&](auto const& name) {
+        auto v = *std::find_if(variables.begin(), variables.end(), [&](auto& v) { return v.Name == name; });
+        auto node = Node(NodeType::Variable, v.Hash);
+        node.Value = 1;
+        return node;
+    };
+
+    SECTION("Reduce")
+    {
+        auto x1 = variable("X1");
+        auto x2 = variable("X2");
+        auto x3 = variable("X3");
+        auto add = Node(NodeType::Add);
+        auto mul = Node(NodeType::Mul);
+        auto tree = Tree { x1, x2, add, x3, add, x1, x2, mul, x3, mul, add };
+        tree.UpdateNodes();
+        auto reduced = Tree(tree).Reduce();
+        REQUIRE(reduced.Length() == 8);
+        REQUIRE(reduced.Nodes().back().Arity == 4);
+        REQUIRE(InfixFormatter::Format(reduced, ds, 0) == "((1 * X3 * 1 * X2 * 1 * X1) + 1 * X3 + 1 * X2 + 1 * X1)");
+
+        auto x1Values = ds.GetValues("X1");
+        auto x2Values = ds.GetValues("X2");
+        auto x3Values = ds.GetValues("X3");
+        auto estimated = Evaluate<Operon::Scalar>(reduced, ds, range);
+        for (size_t i = 0; i < range.Size(); ++i) {
+            auto x = x1Values[i];
+            auto y = x2Values[i];
+            auto z = x3Values[i];
+            REQUIRE(estimated[i] == Approx(x * y * z + x + y + z));
+        }
+    }
+
+    SECTION("Random trees")
+    {
+        Operon::Random random(1234);
+        Grammar grammar;
+        // the flattened sums and products are associated differently, which makes a difference in the last bits
+        // that functions such as exp, sin or tan amplify, so these are left out
+        grammar.SetConfig(Grammar::Arithmetic | NodeType::Log | NodeType::Sqrt | NodeType::Cbrt | NodeType::Square);
+        std::uniform_int_distribution<size_t> sizeDistribution(1, 50);
+        auto creator = BalancedTreeCreator { sizeDistribution, 10, 50 };
+
+        auto same = [](auto const& x, auto const& y) {
+            return std::equal(x.begin(), x.end(), y.begin(), y.end(), [](auto a, auto b) { return a == Approx(b).epsilon(1e-6) || (std::isnan(a) && std::isnan(b)); });
+        };
+        size_t reduced = 0;
+        for (int i = 0; i < 1000; ++i) {
+            auto tree = creator(random, grammar, inputs);
+            auto flat = Tree(tree).Reduce();
+            reduced += flat.Length() < tree.Length();
+            // the plans are evaluated with both buffer layouts
+            for (auto layout : { BufferLayout::Stack, BufferLayout::Linear }) {
+                EvaluationPlan plan(tree, ds, layout);
+                EvaluationPlan flatPlan(flat, ds, layout);
+                REQUIRE(flatPlan.BufferSize() <= flat.Length());
+                REQUIRE(same(Evaluate<Operon::Scalar>(plan, range), Evaluate<Operon::Scalar>(flatPlan, range)));
+            }
+        }
+        REQUIRE(reduced > 0);
+    }
+}
+
+TEST_CASE("Reverse-mode Jacobian", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+    auto range = Range { 0, 250 };
+    auto targetValues = ds.GetValues("Y").subspan(range.Start(), range.Size());
+
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [](const auto& v) { return v.Name != "Y"; });
+
+    Operon::Random random(1234);
+    Grammar grammar;
+    // nested tangents are too ill-conditioned to compare different implementations
+    grammar.SetConfig(Grammar::Full & ~NodeType::Tan);
+    std::uniform_int_distribution<size_t> sizeDistribution(1, 50);
+    auto creator = BalancedTreeCreator { sizeDistribution, 10, 50 };
+
+    auto check = [&](const Tree& tree) {
+        EvaluationPlan plan(tree, ds);
+        auto coef = plan.GetCoefficients();
+        auto n = coef.size();
+        auto m = range.Size();
+
+        ceres::DynamicAutoDiffCostFunction<ParameterizedEvaluation> forward(new ParameterizedEvaluation(plan, targetValues, range));
+        forward.AddParameterBlock(n);
+        forward.SetNumResiduals(m);
+        ReverseModeCostFunction reverse(plan, targetValues, range);
+
+        std::vector<double> r1(m), r2(m), j1(m * n), j2(m * n);
+        double const* parameters[] = { coef.data() };
+        double* jac1[] = { j1.data() };
+        double* jac2[] = { j2.data() };
+        REQUIRE(forward.Evaluate(parameters, r1.data(), jac1));
+        REQUIRE(reverse.Evaluate(parameters, r2.data(), jac2));
+
+        // residuals without Jacobian take the interpreter path
+        std::vector<double> r3(m);
+        REQUIRE(reverse.Evaluate(parameters, r3.data(), nullptr));
+
+        // the Jets use the standard library math functions, so large derivatives may differ more than the values
+        auto close = [](double a, double b, double eps = 1e-6) { return std::abs(a - b) <= eps * std::max({ 1.0, std::abs(a), std::abs(b) }); };
+        for (size_t row = 0; row < m; ++row) {
+            REQUIRE(close(r2[row], r3[row]));
+
+            // the Jet-based evaluation treats values with non-finite derivatives as non-finite (and replaces them),
+            // so the results are only comparable where both agree on the residual. rows replaced due to a non-finite
+            // value have a zero Jacobian row in reverse mode but inherit the derivatives of the replacement with Jets
+            auto replaced = std::all_of(j2.begin() + row * n, j2.begin() + (row + 1) * n, [](auto v) { return v == 0; });
+            if (replaced || !close(r1[row], r3[row])) {
+                continue;
+            }
+            for (size_t col = 0; col < n; ++col) {
+                auto a = j1[row * n + col];
+                if (std::isfinite(a)) {
+                    REQUIRE(close(a, j2[row * n + col], 1e-4));
+                }
+            }
+        }
+    };
+
+    for (int i = 0; i < 100; ++i) {
+        auto tree = creator(random, grammar, inputs);
+        check(tree);
+        // the same tree with the nested additions and multiplications flattened into n-ary nodes
+        check(Tree(tree).Reduce());
+    }
+}
+
+TEST_CASE("Reverse-mode Jacobian (singular points)", "[implementation]")
+{
+    // sqrt(w * x) has a finite value but an infinite derivative with respect to w where x = 0
+    size_t m = 100;
+    std::vector<Variable> variables { { "X", Operon::Hash { 1 }, 0 }, { "Y", Operon::Hash { 2 }, 1 } };
+    std::vector<std::vector<Operon::Scalar>> values(2, std::vector<Operon::Scalar>(m));
+    for (size_t i = 0; i < m; ++i) {
+        auto x = i % 4 == 0 ? Operon::Scalar { 0 } : static_cast<Operon::Scalar>(i) / 10;
+        values[0][i] = x;
+        values[1][i] = std::sqrt(3 * x);
+    }
+    auto ds = Dataset(variables, values);
+    auto range = Range { 0, m };
+    auto targetValues = ds.GetValues("Y").subspan(range.Start(), range.Size());
+
+    auto x = Node(NodeType::Variable, variables[0].Hash);
+    x.Value = 1;
+    auto tree = Tree({ x, Node(NodeType::Sqrt) }).UpdateNodes();
+
+    EvaluationPlan plan(tree, ds);
+    auto coef = plan.GetCoefficients();
+    REQUIRE(coef.size() == 1);
+    ReverseModeCostFunction reverse(plan, targetValues, range);
+    std::vector<double> residuals(m), jacobian(m);
+    double const* parameters[] = { coef.data() };
+    double* jacobians[] = { jacobian.data() };
+    REQUIRE(reverse.Evaluate(parameters, residuals.data(), jacobians));
+    for (size_t i = 0; i < m; ++i) {
+        REQUIRE(std::isfinite(residuals[i]));
+        REQUIRE(std::isfinite(jacobian[i]));
+        if (values[0][i] == 0) {
+            REQUIRE(jacobian[i] == 0);
+        }
+    }
+
+    // the rows with non-finite partials must not make the solver reject the evaluation
+    auto summary = OptimizeReverse(tree, plan, targetValues, range, 50, true, false);
+    REQUIRE(summary.final_cost < summary.initial_cost);
+    REQUIRE(std::abs(tree[0].Value - 3) < 1e-3);
+}
+
 TEST_CASE("Constant optimization (autodiff)", "[implementation]")
 {
     auto ds = Dataset("../data/Poly-10.csv", true);
@@ -286,6 +601,1090 @@ TEST_CASE("Constant optimization (numeric)", "[implementation]")
     fmt::print("{}\n", InfixFormatter::Format(poly10, ds, 6));
 }
 
+TEST_CASE("Constant optimization (Levenberg-Marquardt)", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+
+    auto range = Range { 0, 250 };
+    auto targetValues = ds.GetValues("Y").subspan(range.Start(), range.Size());
+
+    auto variable = [&](auto const& name) {
+        auto v = *std::find_if(variables.begin(), variables.end(), [&](auto& v) { return v.Name == name; });
+        auto node = Node(NodeType::Variable, v.Hash);
+        node.Value = 0.001;
+        return node;
+    };
+    auto x1 = variable("X1");
+    auto x2 = variable("X2");
+    auto x3 = variable("X3");
+    auto x4 = variable("X4");
+    auto x5 = variable("X5");
+    auto x6 = variable("X6");
+    auto x7 = variable("X7");
+    auto x9 = variable("X9");
+    auto x10 = variable("X10");
+
+    auto add = Node(NodeType::Add);
+    auto mul = Node(NodeType::Mul);
+
+    SECTION("Poly-10")
+    {
+        // the structure of the target function, so the solver should find an exact fit
+        auto poly10 = Tree { x1, x2, mul, x3, x4, mul, add, x5, x6, mul, add, x1, x7, mul, x9, mul, add, x3, x6, mul, x10, mul, add };
+        poly10.UpdateNodes();
+        EvaluationPlan plan(poly10, ds);
+
+        auto summary = OptimizeLevenbergMarquardt(poly10, plan, targetValues, range, 100);
+        fmt::print("{}\n", InfixFormatter::Format(poly10, ds, 6));
+        fmt::print("iterations: {}, cost: {} -> {}\n", summary.Iterations, summary.InitialCost, summary.FinalCost);
+        REQUIRE(summary.FinalCost < 1e-6 * summary.InitialCost);
+
+        // the coefficients should have been written back into the tree and the plan
+        auto estimated = Evaluate<Operon::Scalar>(plan, range);
+        REQUIRE(NormalizedMeanSquaredError(estimated, targetValues) < 1e-6);
+        auto coef = poly10.GetCoefficients();
+        REQUIRE(std::equal(coef.begin(), coef.end(), plan.GetCoefficients().begin()));
+    }
+
+    SECTION("Random trees")
+    {
+        std::vector<Variable> inputs;
+        std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [](const auto& v) { return v.Name != "Y"; });
+
+        Operon::Random random(1234);
+        Grammar grammar;
+        grammar.SetConfig(Grammar::Full);
+        std::uniform_int_distribution<size_t> sizeDistribution(1, 50);
+        auto creator = BalancedTreeCreator { sizeDistribution, 10, 50 };
+
+        for (int i = 0; i < 100; ++i) {
+            auto tree = creator(random, grammar, inputs);
+            EvaluationPlan plan(tree, ds);
+            auto summary = OptimizeLevenbergMarquardt(tree, plan, targetValues, range, 50);
+            REQUIRE(summary.Iterations <= 50);
+            REQUIRE(summary.SuccessfulSteps <= summary.Iterations);
+            // one evaluation for the initial coefficients plus at most one per step (accepted steps are not re-evaluated)
+            REQUIRE(summary.Evaluations <= summary.Iterations + 1);
+            REQUIRE(summary.FinalCost <= summary.InitialCost);
+        }
+    }
+}
+
+TEST_CASE("Subsampled local optimization", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+
+    SECTION("Dataset subset")
+    {
+        std::vector<gsl::index> rows { 3, 1, 4, 1, 5, 9, 2, 6 };
+        auto subset = ds.Subset(rows);
+        REQUIRE(subset.Rows() == rows.size());
+        REQUIRE(subset.Cols() == ds.Cols());
+        for (auto const& v : variables) {
+            auto values = ds.GetValues(v.Hash);
+            auto subsetValues = subset.GetValues(v.Hash);
+            for (size_t i = 0; i < rows.size(); ++i) {
+                REQUIRE(subsetValues[i] == values[rows[i]]);
+            }
+        }
+    }
+
+    auto variable = [&](auto const& name) {
+        auto v = *std::find_if(variables.begin(), variables.end(), [&](auto& v) { return v.Name == name; });
+        auto node = Node(NodeType::Variable, v.Hash);
+        node.Value = 0.001;
+        return node;
+    };
+    auto x1 = variable("X1");
+    auto x2 = variable("X2");
+    auto x3 = variable("X3");
+    auto x4 = variable("X4");
+    auto x5 = variable("X5");
+    auto x6 = variable("X6");
+    auto x7 = variable("X7");
+    auto x9 = variable("X9");
+    auto x10 = variable("X10");
+    auto add = Node(NodeType::Add);
+    auto mul = Node(NodeType::Mul);
+
+    auto problem = Problem(ds, variables, "Y", Range { 0, 250 }, Range { 250, 500 });
+    RSquaredEvaluator<Individual<1>> evaluator(problem);
+    evaluator.LocalOptimizationIterations(100);
+    evaluator.LocalOptimizationSampleSize(50);
+
+    Operon::Random random(1234);
+
+    auto check = [&]() {
+        // the sample is redrawn on every call
+        evaluator.Resample(random);
+        auto sample = evaluator.LocalOptimizationSample();
+        REQUIRE(sample != nullptr);
+        REQUIRE(sample->Rows() == 50);
+
+        Individual<1> ind;
+        ind.Genotype = Tree { x1, x2, mul, x3, x4, mul, add, x5, x6, mul, add, x1, x7, mul, x9, mul, add, x3, x6, mul, x10, mul, add };
+        ind.Genotype.UpdateNodes();
+        // the coefficients fitted on the sample generalize to the whole training range
+        auto fitness = evaluator(random, ind);
+        REQUIRE(fitness < 1e-6);
+    };
+
+    SECTION("Random sampling")
+    {
+        evaluator.LocalOptimizationSampling(RowSampling::Random);
+        check();
+    }
+
+    SECTION("Stratified sampling")
+    {
+        evaluator.LocalOptimizationSampling(RowSampling::Stratified);
+        check();
+
+        // every stratum of the sorted training targets is represented exactly once
+        auto sampleTargets = evaluator.LocalOptimizationSample()->GetValues("Y");
+        std::vector<Operon::Scalar> sorted(problem.TargetValues().begin(), problem.TargetValues().begin() + 250);
+        std::sort(sorted.begin(), sorted.end());
+        std::vector<Operon::Scalar> sampled(sampleTargets.begin(), sampleTargets.end());
+        std::sort(sampled.begin(), sampled.end());
+        for (size_t i = 0; i < sampled.size(); ++i) {
+            REQUIRE(sampled[i] >= sorted[i * 5]);
+            REQUIRE(sampled[i] <= sorted[i * 5 + 4]);
+        }
+    }
+
+    SECTION("Stratified sampling with missing targets")
+    {
+        // every third target is missing, leaving 66 finite targets out of 100
+        size_t m = 100;
+        std::vector<Variable> vars { { "X", Operon::Hash { 1 }, 0 }, { "Y", Operon::Hash { 2 }, 1 } };
+        std::vector<std::vector<Operon::Scalar>> values(2, std::vector<Operon::Scalar>(m));
+        for (size_t i = 0; i < m; ++i) {
+            values[0][i] = static_cast<Operon::Scalar>(i);
+            values[1][i] = i % 3 == 0 ? std::numeric_limits<Operon::Scalar>::quiet_NaN() : static_cast<Operon::Scalar>(m - i);
+        }
+        auto missing = Dataset(vars, values);
+        auto missingProblem = Problem(missing, vars, "Y", Range { 0, m }, Range { 0, m });
+        RSquaredEvaluator<Individual<1>> stratified(missingProblem);
+        stratified.LocalOptimizationSampling(RowSampling::Stratified);
+
+        // only rows with a finite target are drawn while there are enough of them
+        stratified.LocalOptimizationSampleSize(20);
+        stratified.Resample(random);
+        auto targets = stratified.LocalOptimizationSample()->GetValues("Y");
+        REQUIRE(targets.size() == 20);
+        REQUIRE(std::all_of(targets.begin(), targets.end(), [](auto v) { return std::isfinite(v); }));
+
+        // otherwise the sample holds all of them
+        stratified.LocalOptimizationSampleSize(80);
+        stratified.Resample(random);
+        targets = stratified.LocalOptimizationSample()->GetValues("Y");
+        REQUIRE(targets.size() == 80);
+        REQUIRE(std::count_if(targets.begin(), targets.end(), [](auto v) { return std::isfinite(v); }) == 66);
+    }
+
+    SECTION("No sampling")
+    {
+        evaluator.LocalOptimizationSampleSize(0);
+        evaluator.Resample(random);
+        REQUIRE(evaluator.LocalOptimizationSample() == nullptr);
+    }
+}
+
+TEST_CASE("Racing evaluation", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+
+    auto variable = [&](auto const& name) {
+        auto v = *std::find_if(variables.begin(), variables.end(), [&](auto& v) { return v.Name == name; });
+        auto node = Node(NodeType::Variable, v.Hash);
+        node.Value = 0.001;
+        return node;
+    };
+    auto x1 = variable("X1");
+    auto x2 = variable("X2");
+    auto x3 = variable("X3");
+    auto x4 = variable("X4");
+    auto x5 = variable("X5");
+    auto x6 = variable("X6");
+    auto x7 = variable("X7");
+    auto x9 = variable("X9");
+    auto x10 = variable("X10");
+    auto add = Node(NodeType::Add);
+    auto mul = Node(NodeType::Mul);
+
+    auto good = Tree { x1, x2, mul, x3, x4, mul, add, x5, x6, mul, add, x1, x7, mul, x9, mul, add, x3, x6, mul, x10, mul, add };
+    good.UpdateNodes();
+    auto bad = Tree { x1, x2, add };
+    bad.UpdateNodes();
+
+    auto problem = Problem(ds, variables, "Y", Range { 0, 250 }, Range { 250, 500 });
+    Operon::Random random(1234);
+
+    auto check = [&](auto& evaluator) {
+        evaluator.LocalOptimizationIterations(100);
+        evaluator.RacingSampleSize(50);
+        evaluator.Resample(random);
+        REQUIRE(evaluator.RacingSample() != nullptr);
+
+        Individual<1> ind;
+
+        // a candidate that passes the race gets the same fitness as without a threshold
+        ind.Genotype = good;
+        auto f0 = evaluator(random, ind);
+        ind.Genotype = good;
+        auto f1 = evaluator(random, ind, 0.5);
+        REQUIRE(f0 == f1);
+        REQUIRE(evaluator.RacingRejections() == 0);
+
+        // a hopeless candidate is rejected on the sample, before its coefficients are optimized
+        ind.Genotype = bad;
+        auto localEvaluations = evaluator.LocalEvaluations();
+        auto f2 = evaluator(random, ind, 0.01);
+        REQUIRE(f2 > 0.01);
+        REQUIRE(evaluator.RacingRejections() == 1);
+        REQUIRE(evaluator.LocalEvaluations() == localEvaluations);
+
+        // without a threshold there is no racing
+        ind.Genotype = bad;
+        evaluator(random, ind);
+        REQUIRE(evaluator.RacingRejections() == 1);
+        REQUIRE(evaluator.FitnessEvaluations() == 4);
+    };
+
+    SECTION("R2")
+    {
+        RSquaredEvaluator<Individual<1>> evaluator(problem);
+        check(evaluator);
+    }
+
+    SECTION("NMSE")
+    {
+        NormalizedMeanSquaredErrorEvaluator<Individual<1>> evaluator(problem);
+        check(evaluator);
+    }
+}
+
+TEST_CASE("Row index sets", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+
+    auto variable = [&](auto const& name) {
+        auto v = *std::find_if(variables.begin(), variables.end(), [&](auto& v) { return v.Name == name; });
+        auto node = Node(NodeType::Variable, v.Hash);
+        node.Value = 0.001;
+        return node;
+    };
+    auto x1 = variable("X1");
+    auto x2 = variable("X2");
+    auto x3 = variable("X3");
+    auto x4 = variable("X4");
+    auto add = Node(NodeType::Add);
+    auto mul = Node(NodeType::Mul);
+    auto tree = Tree { x1, x2, mul, x3, x4, mul, add, x1, add };
+    tree.UpdateNodes();
+
+    // the training rows of a 5-fold cross-validation split (every fifth row is left out), in shuffled order
+    std::vector<gsl::index> rows;
+    for (gsl::index i = 0; i < ds.Rows(); ++i) {
+        if (i % 5 != 2) {
+            rows.push_back(i);
+        }
+    }
+    Operon::Random random(1234);
+    std::shuffle(rows.begin(), rows.end(), random);
+    auto subset = ds.Subset(rows);
+    auto range = Range { 0, rows.size() };
+
+    SECTION("Evaluate")
+    {
+        auto expected = Evaluate<Operon::Scalar>(tree, subset, range);
+        EvaluationPlan plan(tree, ds);
+        auto actual = Evaluate<Operon::Scalar>(plan, gsl::span<const gsl::index>(rows));
+        REQUIRE(std::equal(expected.begin(), expected.end(), actual.begin(), actual.end()));
+
+        ds.CacheSinglePrecision();
+        subset.CacheSinglePrecision();
+        auto expectedSingle = Evaluate<float>(tree, subset, range);
+        plan.Compile(tree, ds);
+        auto actualSingle = Evaluate<float>(plan, gsl::span<const gsl::index>(rows));
+        REQUIRE(std::equal(expectedSingle.begin(), expectedSingle.end(), actualSingle.begin(), actualSingle.end()));
+    }
+
+    SECTION("Levenberg-Marquardt")
+    {
+        auto t1 = tree;
+        EvaluationPlan p1(t1, subset);
+        auto s1 = OptimizeLevenbergMarquardt(t1, p1, subset.GetValues("Y"), range, 20);
+
+        auto t2 = tree;
+        EvaluationPlan p2(t2, ds);
+        std::vector<Operon::Scalar> targets;
+        for (auto i : rows) {
+            targets.push_back(ds.GetValues("Y")[i]);
+        }
+        auto s2 = OptimizeLevenbergMarquardt(t2, p2, targets, gsl::span<const gsl::index>(rows), 20);
+
+        REQUIRE(s1.Iterations == s2.Iterations);
+        REQUIRE(s1.FinalCost == Approx(s2.FinalCost));
+        auto c1 = t1.GetCoefficients();
+        auto c2 = t2.GetCoefficients();
+        for (size_t i = 0; i < c1.size(); ++i) {
+            REQUIRE(c1[i] == Approx(c2[i]));
+        }
+    }
+
+    SECTION("Evaluators")
+    {
+        auto testRows = std::vector<gsl::index> { 2, 7, 12 };
+        auto folded = Problem(ds, variables, "Y", rows, testRows);
+        auto copied = Problem(subset, subset.Variables(), "Y", range, Range { 0, 0 });
+        REQUIRE(folded.TrainingRange().Size() == rows.size());
+        REQUIRE(folded.TestRows().size() == testRows.size());
+
+        auto fitness = [&](auto& problem) {
+            NormalizedMeanSquaredErrorEvaluator<Individual<1>> evaluator(problem);
+            evaluator.LocalOptimizationIterations(10);
+            Individual<1> ind;
+            ind.Genotype = tree;
+            return evaluator(random, ind);
+        };
+        REQUIRE(fitness(folded) == Approx(fitness(copied)));
+    }
+}
+
+TEST_CASE("Subtree cache", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+    auto range = Range { 0, 250 };
+
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [](const auto& v) { return v.Name != "Y"; });
+
+    Operon::Random random(1234);
+    Grammar grammar;
+    grammar.SetConfig(Grammar::Full);
+    std::uniform_int_distribution<size_t> sizeDistribution(1, 50);
+    auto creator = BalancedTreeCreator { sizeDistribution, 10, 50 };
+    std::vector<Tree> trees(100);
+    std::generate(trees.begin(), trees.end(), [&]() { return creator(random, grammar, inputs); });
+
+    // offspring share subtrees with their parents
+    SubtreeCrossover crossover { 0.9, 10, 50 };
+    std::vector<Tree> offspring(100);
+    std::uniform_int_distribution<size_t> parent(0, trees.size() - 1);
+    std::generate(offspring.begin(), offspring.end(), [&]() { return crossover(random, trees[parent(random)], trees[parent(random)]); });
+
+    auto same = [](auto const& x, auto const& y) {
+        return std::equal(x.begin(), x.end(), y.begin(), y.end(), [](auto a, auto b) { return a == b || (std::isnan(a) && std::isnan(b)); });
+    };
+
+    SubtreeCache cache;
+    auto check = [&](Tree const& tree, BufferLayout layout) {
+        EvaluationPlan plan(tree, ds, layout);
+        auto expected = Evaluate<Operon::Scalar>(plan, range);
+        Operon::Vector<Operon::Scalar> actual(range.Size());
+        Evaluate(plan, range, actual, cache);
+        return same(expected, actual);
+    };
+
+    SECTION("Values")
+    {
+        // subtrees are admitted to the cache the second time they are seen
+        for (auto const& tree : trees) {
+            REQUIRE(check(tree, BufferLayout::Stack));
+        }
+        REQUIRE(cache.GetStatistics().Insertions == 0);
+        for (auto const& tree : trees) {
+            REQUIRE(check(tree, BufferLayout::Stack));
+        }
+        auto stats = cache.GetStatistics();
+        REQUIRE(stats.Insertions > 0);
+        REQUIRE(stats.Entries == stats.Insertions);
+
+        // (nearly) everything is found in the cache afterwards, the admission table is lossy
+        cache.ResetStatistics();
+        for (auto const& tree : trees) {
+            REQUIRE(check(tree, BufferLayout::Stack));
+            REQUIRE(check(tree, BufferLayout::Linear));
+        }
+        REQUIRE(cache.GetStatistics().HitRate() > 0.9);
+
+        cache.ResetStatistics();
+        for (auto const& tree : offspring) {
+            REQUIRE(check(tree, BufferLayout::Stack));
+        }
+        REQUIRE(cache.GetStatistics().Hits > 0);
+
+        // other coefficients and other ranges do not match the cached values
+        cache.ResetStatistics();
+        for (auto tree : trees) {
+            auto coef = tree.GetCoefficients();
+            std::transform(coef.begin(), coef.end(), coef.begin(), [](auto v) { return v + 1; });
+            tree.SetCoefficients(coef);
+            REQUIRE(check(tree, BufferLayout::Stack));
+        }
+        range = Range { 250, 250 };
+        for (auto const& tree : trees) {
+            REQUIRE(check(tree, BufferLayout::Stack));
+        }
+        REQUIRE(cache.GetStatistics().Hits == 0);
+    }
+
+    SECTION("Modified dataset")
+    {
+        for (int i = 0; i < 2; ++i) {
+            for (auto const& tree : trees) {
+                REQUIRE(check(tree, BufferLayout::Stack));
+            }
+        }
+        REQUIRE(cache.GetStatistics().Insertions > 0);
+
+        // the values cached before the dataset was modified in place are not returned afterwards
+        auto version = ds.Version();
+        ds.Shuffle(random);
+        REQUIRE(ds.Version() != version);
+        cache.ResetStatistics();
+        for (auto const& tree : trees) {
+            REQUIRE(check(tree, BufferLayout::Stack));
+        }
+        REQUIRE(cache.GetStatistics().Hits == 0);
+
+        for (auto const& tree : trees) {
+            REQUIRE(check(tree, BufferLayout::Stack));
+        }
+        std::vector<gsl::index> columns(ds.Cols());
+        std::iota(columns.begin(), columns.end(), 0);
+        ds.Standardize(columns, range);
+        cache.ResetStatistics();
+        for (auto const& tree : trees) {
+            REQUIRE(check(tree, BufferLayout::Stack));
+        }
+        REQUIRE(cache.GetStatistics().Hits == 0);
+
+        // a copy holds the same values in other storage, so it uses the cached values
+        for (auto const& tree : trees) {
+            REQUIRE(check(tree, BufferLayout::Stack));
+        }
+        auto copy = ds;
+        REQUIRE(copy.Version() == ds.Version());
+        cache.ResetStatistics();
+        for (auto const& tree : trees) {
+            EvaluationPlan plan(tree, copy);
+            auto expected = Evaluate<Operon::Scalar>(plan, range);
+            Operon::Vector<Operon::Scalar> actual(range.Size());
+            Evaluate(plan, range, actual, cache);
+            REQUIRE(same(expected, actual));
+        }
+        REQUIRE(cache.GetStatistics().Hits > 0);
+    }
+
+    SECTION("Capacity")
+    {
+        SubtreeCache small(64 * range.Size() * sizeof(Operon::Scalar), 1);
+        for (int i = 0; i < 2; ++i) {
+            for (auto const& tree : trees) {
+                EvaluationPlan plan(tree, ds);
+                auto expected = Evaluate<Operon::Scalar>(plan, range);
+                Operon::Vector<Operon::Scalar> actual(range.Size());
+                Evaluate(plan, range, actual, small);
+                REQUIRE(same(expected, actual));
+            }
+        }
+        auto stats = small.GetStatistics();
+        REQUIRE(stats.Evictions > 0);
+        REQUIRE(stats.Bytes <= small.Capacity());
+        REQUIRE(stats.Entries == stats.Insertions - stats.Evictions);
+        small.Clear();
+        REQUIRE(small.GetStatistics().Entries == 0);
+    }
+
+    SECTION("Evaluator")
+    {
+        auto problem = Problem(ds, variables, "Y", range, Range { 250, 500 });
+        RSquaredEvaluator<Individual<1>> evaluator(problem);
+        evaluator.LocalOptimizationIterations(0);
+        Individual<1> ind;
+        for (auto const& tree : offspring) {
+            ind.Genotype = tree;
+            auto f0 = evaluator(random, ind);
+            evaluator.Cache(&cache);
+            auto f1 = evaluator(random, ind);
+            evaluator.Cache(nullptr);
+            REQUIRE((f0 == f1 || (std::isnan(f0) && std::isnan(f1))));
+        }
+    }
+}
+
+TEST_CASE("Incremental evaluation", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+    auto range = Range { 0, 250 };
+
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [](const auto& v) { return v.Name != "Y"; });
+
+    Operon::Random random(1234);
+    Grammar grammar;
+    grammar.SetConfig(Grammar::Full);
+    std::uniform_int_distribution<size_t> sizeDistribution(1, 50);
+    auto creator = BalancedTreeCreator { sizeDistribution, 10, 50 };
+    std::vector<Tree> trees(100);
+    std::generate(trees.begin(), trees.end(), [&]() { return creator(random, grammar, inputs); });
+
+    SubtreeCrossover crossover { 0.9, 10, 50 };
+    OnePointMutation onePoint;
+    ChangeVariableMutation changeVariable { inputs };
+    ChangeFunctionMutation changeFunction { grammar };
+
+    auto same = [](auto const& x, auto const& y) {
+        return std::equal(x.begin(), x.end(), y.begin(), y.end(), [](auto a, auto b) { return a == b || (std::isnan(a) && std::isnan(b)); });
+    };
+
+    SECTION("Values")
+    {
+        std::uniform_int_distribution<size_t> parent(0, trees.size() - 1);
+        NodeValues values;
+        size_t reused = 0;
+        size_t total = 0;
+        for (int i = 0; i < 1000; ++i) {
+            auto const& p = trees[parent(random)];
+            values.Compute(p, ds, range);
+            Tree child;
+            switch (i % 4) {
+            case 0:
+                child = crossover(random, p, trees[parent(random)]);
+                break;
+            case 1:
+                child = onePoint(random, p);
+                break;
+            case 2:
+                child = changeVariable(random, p);
+                break;
+            default:
+                child = changeFunction(random, p);
+            }
+            EvaluationPlan plan(child, ds);
+            auto expected = Evaluate<Operon::Scalar>(plan, range);
+            Operon::Vector<Operon::Scalar> actual(range.Size());
+            reused += EvaluateIncremental(plan, child, values, actual);
+            total += child.Length();
+            REQUIRE(same(expected, actual));
+        }
+        REQUIRE(reused > total / 2);
+
+        // a tree evaluated from its own values only reads the root
+        auto const& tree = *std::find_if(trees.begin(), trees.end(), [](auto const& t) { return t.Length() > 2 && t[t.Length() - 1].Arity > 1; });
+        values.Compute(tree, ds, range);
+        EvaluationPlan plan(tree, ds);
+        Operon::Vector<Operon::Scalar> actual(range.Size());
+        REQUIRE(EvaluateIncremental(plan, tree, values, actual) == tree.Length());
+        REQUIRE(same(Evaluate<Operon::Scalar>(plan, range), actual));
+
+        // another coefficient in the first leaf only excludes the subtrees containing it (the path to the root)
+        auto changed = tree;
+        changed[0].Value += 1;
+        EvaluationPlan changedPlan(changed, ds);
+        auto shared = EvaluateIncremental(changedPlan, changed, values, actual);
+        REQUIRE(shared > 0);
+        REQUIRE(shared < changed.Length());
+        REQUIRE(same(Evaluate<Operon::Scalar>(changedPlan, range), actual));
+    }
+
+    SECTION("Shorter child")
+    {
+        // a * (b + x) and a * b share a prefix and a suffix but the root of the child spans both affixes
+        auto variable = [&](auto const& name) {
+            auto v = *std::find_if(variables.begin(), variables.end(), [&](auto& v) { return v.Name == name; });
+            auto node = Node(NodeType::Variable, v.Hash);
+            node.Value = 1;
+            return node;
+        };
+        auto a = variable("X1");
+        auto b = variable("X2");
+        auto x = variable("X3");
+        auto parent = Tree { a, b, x, Node(NodeType::Add), Node(NodeType::Mul) };
+        parent.UpdateNodes();
+        auto child = Tree { a, b, Node(NodeType::Mul) };
+        child.UpdateNodes();
+
+        NodeValues values;
+        values.Compute(parent, ds, range);
+        EvaluationPlan plan(child, ds);
+        Operon::Vector<Operon::Scalar> actual(range.Size());
+        auto shared = EvaluateIncremental(plan, child, values, actual);
+        REQUIRE(shared == 2);
+        REQUIRE(same(Evaluate<Operon::Scalar>(plan, range), actual));
+    }
+
+    SECTION("Evaluator")
+    {
+        auto problem = Problem(ds, variables, "Y", range, Range { 250, 500 });
+        NormalizedMeanSquaredErrorEvaluator<Individual<1>> evaluator(problem);
+        evaluator.LocalOptimizationIterations(0);
+        // one point mutation of a larger tree keeps most of its nodes
+        std::vector<Individual<1>> parents;
+        for (auto const& tree : trees) {
+            if (tree.Length() >= 10) {
+                auto& ind = parents.emplace_back();
+                ind.Genotype = tree;
+                ind[0] = evaluator(random, ind);
+            }
+        }
+        evaluator.RetainedParents(10);
+        evaluator.Retain(parents);
+
+        auto best = std::min_element(parents.begin(), parents.end(), [](auto const& a, auto const& b) { return a[0] < b[0]; });
+        for (int i = 0; i < 100; ++i) {
+            Individual<1> ind;
+            ind.Genotype = onePoint(random, best->Genotype);
+            auto f0 = evaluator(random, ind);
+            evaluator.RetainedParents(0);
+            evaluator.Retain(parents);
+            auto f1 = evaluator(random, ind);
+            evaluator.RetainedParents(10);
+            evaluator.Retain(parents);
+            REQUIRE((f0 == f1 || (std::isnan(f0) && std::isnan(f1))));
+        }
+        REQUIRE(evaluator.IncrementalEvaluations() == 100);
+    }
+
+    SECTION("Evaluator with local optimization")
+    {
+        // the optimized coefficients of the offspring differ from those of its parent, only the subtrees whose
+        // coefficients are unchanged may be read from the parent values
+        auto problem = Problem(ds, variables, "Y", range, Range { 250, 500 });
+        NormalizedMeanSquaredErrorEvaluator<Individual<1>> evaluator(problem);
+        evaluator.LocalOptimizationIterations(10);
+        std::vector<Individual<1>> parents;
+        for (auto const& tree : trees) {
+            if (tree.Length() >= 10) {
+                auto& ind = parents.emplace_back();
+                ind.Genotype = tree;
+                ind[0] = evaluator(random, ind);
+            }
+        }
+        evaluator.RetainedParents(10);
+        evaluator.Retain(parents);
+
+        auto best = std::min_element(parents.begin(), parents.end(), [](auto const& a, auto const& b) { return a[0] < b[0]; });
+        for (int i = 0; i < 100; ++i) {
+            auto child = onePoint(random, best->Genotype);
+            Individual<1> ind;
+            ind.Genotype = child;
+            auto f0 = evaluator(random, ind);
+            evaluator.RetainedParents(0);
+            evaluator.Retain(parents);
+            ind.Genotype = child;
+            auto f1 = evaluator(random, ind);
+            evaluator.RetainedParents(10);
+            evaluator.Retain(parents);
+            REQUIRE((f0 == f1 || (std::isnan(f0) && std::isnan(f1))));
+        }
+    }
+}
+
+TEST_CASE("Native code", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [](const auto& v) { return v.Name != "Y"; });
+
+    Operon::Random random(1234);
+    Grammar grammar;
+    grammar.SetConfig(Grammar::Arithmetic | NodeType::Square | NodeType::Sqrt);
+    std::uniform_int_distribution<size_t> sizeDistribution(1, 100);
+    auto creator = BalancedTreeCreator { sizeDistribution, 10, 100 };
+    std::vector<Tree> trees(100);
+    std::generate(trees.begin(), trees.end(), [&]() { return creator(random, grammar, inputs); });
+
+    // the interpreter's vectorized square root may differ from the correctly rounded one in the last bit
+    auto same = [](auto const& x, auto const& y) {
+        return std::equal(x.begin(), x.end(), y.begin(), y.end(), [](auto a, auto b) { return a == Approx(b).epsilon(1e-12) || (std::isnan(a) && std::isnan(b)); });
+    };
+
+    if (!NativePlan::Supported()) {
+        WARN("native code is not supported on this platform");
+        return;
+    }
+
+    SECTION("Values")
+    {
+        NativePlan native;
+        for (auto const& tree : trees) {
+            EvaluationPlan plan(tree, ds);
+            REQUIRE(native.Compile(plan));
+            // partial blocks at the end of the range and ranges shorter than a block
+            for (auto range : { Range { 0, 250 }, Range { 7, 250 }, Range { 3, 11 }, Range { 1, 3 } }) {
+                auto expected = Evaluate<Operon::Scalar>(plan, range);
+                Operon::Vector<Operon::Scalar> actual(range.Size());
+                native.Evaluate(range, nullptr, actual);
+                REQUIRE(same(expected, actual));
+            }
+            // the coefficients are read at every evaluation
+            auto range = Range { 0, 100 };
+            auto coef = tree.GetCoefficients();
+            std::transform(coef.begin(), coef.end(), coef.begin(), [](auto v) { return v + 1; });
+            auto expected = Evaluate<Operon::Scalar>(plan, range, coef.data());
+            Operon::Vector<Operon::Scalar> actual(range.Size());
+            native.Evaluate(range, coef.data(), actual);
+            REQUIRE(same(expected, actual));
+
+            // n-ary additions and multiplications (which may need more registers than the binary tree)
+            EvaluationPlan reduced(Tree(tree).Reduce(), ds);
+            if (native.Compile(reduced)) {
+                expected = Evaluate<Operon::Scalar>(reduced, range);
+                native.Evaluate(range, nullptr, actual);
+                REQUIRE(same(expected, actual));
+            }
+        }
+
+        // plans with other node types are not supported
+        auto x = Node(NodeType::Variable, inputs.front().Hash);
+        x.Value = 1;
+        auto tree = Tree { x, Node(NodeType::Exp) };
+        tree.UpdateNodes();
+        REQUIRE(!native.Compile(EvaluationPlan(tree, ds)));
+        REQUIRE(!native.IsCompiled());
+    }
+
+    SECTION("Cost function")
+    {
+        // the residuals without Jacobian are evaluated with the native code of the plan
+        auto range = Range { 0, 250 };
+        auto targetValues = ds.GetValues("Y").subspan(range.Start(), range.Size());
+        NativePlan native;
+        for (auto const& tree : trees) {
+            EvaluationPlan plan(tree, ds);
+            REQUIRE(native.Compile(plan));
+            auto coef = plan.GetCoefficients();
+            std::transform(coef.begin(), coef.end(), coef.begin(), [](auto v) { return v + 1; });
+            double const* parameters[] = { coef.data() };
+
+            ReverseModeCostFunction cost(plan, targetValues, range);
+            std::vector<double> expected(range.Size());
+            REQUIRE(cost.Evaluate(parameters, expected.data(), nullptr));
+            cost.Native(&native);
+            std::vector<double> actual(range.Size());
+            REQUIRE(cost.Evaluate(parameters, actual.data(), nullptr));
+            REQUIRE(same(expected, actual));
+        }
+    }
+
+    SECTION("Evaluator")
+    {
+        // without square roots the native code gives exactly the values of the interpreter, so the local search
+        // takes the same steps
+        Grammar arithmetic;
+        arithmetic.SetConfig(Grammar::Arithmetic);
+        auto problem = Problem(ds, variables, "Y", Range { 0, 250 }, Range { 250, 500 });
+        RSquaredEvaluator<Individual<1>> evaluator(problem);
+        evaluator.LocalOptimizationMethod(LocalOptimizer::Ceres);
+        evaluator.LocalOptimizationIterations(10);
+        Individual<1> ind;
+        for (int i = 0; i < 20; ++i) {
+            auto tree = creator(random, arithmetic, inputs);
+            ind.Genotype = tree;
+            evaluator.JitThreshold(0);
+            auto f0 = evaluator(random, ind);
+            ind.Genotype = tree;
+            evaluator.JitThreshold(1);
+            auto f1 = evaluator(random, ind);
+            REQUIRE((f0 == f1 || (std::isnan(f0) && std::isnan(f1))));
+        }
+    }
+}
+
+TEST_CASE("Tree simplification", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+    auto range = Range { 0, 250 };
+
+    auto variable = [&](auto const& name, Operon::Scalar weight) {
+        auto v = *std::find_if(variables.begin(), variables.end(), [&](auto& v) { return v.Name == name; });
+        auto node = Node(NodeType::Variable, v.Hash);
+        node.Value = weight;
+        return node;
+    };
+    auto constant = [](Operon::Scalar value) {
+        auto node = Node(NodeType::Constant);
+        node.Value = value;
+        return node;
+    };
+    auto x1 = variable("X1", 2);
+    auto x2 = variable("X2", 3);
+    auto add = Node(NodeType::Add);
+    auto sub = Node(NodeType::Sub);
+    auto mul = Node(NodeType::Mul);
+    auto div = Node(NodeType::Div);
+    auto log = Node(NodeType::Log);
+    auto exp = Node(NodeType::Exp);
+
+    auto simplify = [](Tree tree) {
+        tree.UpdateNodes();
+        return tree.Simplify();
+    };
+
+    SECTION("Rules")
+    {
+        // constant folding (the postfix order puts the second operand first)
+        auto t = simplify(Tree { constant(2), constant(1), exp, constant(3), mul, add });
+        REQUIRE(t.Length() == 1);
+        REQUIRE(t[0].IsConstant());
+        REQUIRE(t[0].Value == Approx(3 * std::exp(1.0) + 2));
+        // non-finite results are not folded
+        REQUIRE(simplify(Tree { constant(-1), log }).Length() == 2);
+        REQUIRE(simplify(Tree { constant(0), constant(1), div }).Length() == 3);
+
+        // identities and annihilators
+        REQUIRE(simplify(Tree { x1, constant(0), add }).Length() == 1);
+        REQUIRE(simplify(Tree { constant(0), x1, sub }).Length() == 1);
+        REQUIRE(simplify(Tree { constant(1), x1, x2, add, mul }).Length() == 3);
+        REQUIRE(simplify(Tree { constant(1), x1, div }).Length() == 1);
+        t = simplify(Tree { x2, x1, add, constant(0), mul, x2, add });
+        REQUIRE(t.Length() == 1);
+        REQUIRE(t[0].IsVariable());
+        t = simplify(Tree { x2, x1, add, x2, x1, add, sub });
+        REQUIRE(t.Length() == 1);
+        REQUIRE(t[0].IsConstant());
+        REQUIRE(t[0].Value == 0);
+        t = simplify(Tree { x2, exp, x2, exp, div });
+        REQUIRE(t.Length() == 1);
+        REQUIRE(t[0].Value == 1);
+
+        // coefficients merged into variable weights
+        t = simplify(Tree { x1, constant(5), mul });
+        REQUIRE(t.Length() == 1);
+        REQUIRE(t[0].IsVariable());
+        REQUIRE(t[0].Value == 10);
+        t = simplify(Tree { constant(4), x1, div });
+        REQUIRE(t[0].Value == 0.5);
+        t = simplify(Tree { variable("X1", 5), x1, sub });
+        REQUIRE(t.Length() == 1);
+        REQUIRE(t[0].Value == -3);
+        t = simplify(Tree { variable("X1", -2), x1, add, x2, add });
+        REQUIRE(t.Length() == 1);
+        REQUIRE(t[0].HashValue == x2.HashValue);
+        t = simplify(Tree { variable("X1", 4), x1, div });
+        REQUIRE(t.Length() == 1);
+        REQUIRE(t[0].IsConstant());
+        REQUIRE(t[0].Value == 0.5);
+
+        // nested constants
+        t = simplify(Tree { x1, constant(2), add, constant(3), add });
+        REQUIRE(t.Length() == 3);
+        REQUIRE(t.CoefficientsCount() == 2);
+        REQUIRE(t.GetCoefficients() == std::vector<double> { 2, 5 });
+    }
+
+    SECTION("Random trees")
+    {
+        std::vector<Variable> inputs;
+        std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [](const auto& v) { return v.Name != "Y"; });
+        inputs.resize(3); // more chances to combine the same variables
+
+        Operon::Random random(1234);
+        Grammar grammar;
+        grammar.SetConfig(Grammar::Full);
+        std::uniform_int_distribution<size_t> sizeDistribution(1, 50);
+        auto creator = BalancedTreeCreator { sizeDistribution, 10, 50 };
+        std::uniform_int_distribution<int> coin(0, 3);
+
+        size_t before = 0;
+        size_t after = 0;
+        for (int i = 0; i < 1000; ++i) {
+            auto tree = creator(random, grammar, inputs);
+            // make some of the coefficients identities or annihilators
+            for (auto& s : tree.Nodes()) {
+                if (s.IsConstant() || s.IsVariable()) {
+                    if (auto c = coin(random); c < 2) {
+                        s.Value = c;
+                    }
+                }
+            }
+            auto expected = Evaluate<Operon::Scalar>(tree, ds, range);
+            auto simplified = tree;
+            simplified.Simplify();
+            REQUIRE(simplified.Length() <= tree.Length());
+            before += tree.Length();
+            after += simplified.Length();
+
+            // the simplification only holds where the values of all the nodes are finite
+            NodeValues values(tree, ds, range);
+            auto finite = [](auto const* v, size_t n) { return std::all_of(v, v + n, [](auto x) { return std::isfinite(x); }); };
+            bool skip = false;
+            for (size_t j = 0; j < tree.Length(); ++j) {
+                skip |= !finite(values.Column(j), range.Size());
+            }
+            if (skip) {
+                continue;
+            }
+            auto actual = Evaluate<Operon::Scalar>(simplified, ds, range);
+            for (size_t j = 0; j < expected.size(); ++j) {
+                REQUIRE(actual[j] == Approx(expected[j]).epsilon(1e-6).margin(1e-6));
+            }
+            // the simplified tree is evaluated the same way by the plan
+            EvaluationPlan plan;
+            plan.Compile(simplified, ds);
+            REQUIRE(plan.CoefficientsCount() == simplified.CoefficientsCount());
+        }
+        fmt::print("simplification: {} -> {} nodes\n", before, after);
+        REQUIRE(after < before);
+    }
+}
+
+TEST_CASE("Fitness memoization", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+
+    SECTION("Eviction")
+    {
+        // hashes which fall into the same shard, two entries per shard
+        auto hash = [](uint64_t i) { return Operon::Hash { i << 38 }; };
+        auto entry = FitnessCache::Entry { 1.0, {} };
+        for (auto policy : { FitnessCache::Eviction::FirstInFirstOut, FitnessCache::Eviction::LeastRecentlyUsed }) {
+            FitnessCache cache(128, policy);
+            cache.Insert(hash(1), entry);
+            cache.Insert(hash(2), entry);
+            REQUIRE(cache.Find(hash(1), entry));
+            cache.Insert(hash(3), entry);
+            auto stats = cache.GetStatistics();
+            REQUIRE(stats.Entries == 2);
+            REQUIRE(stats.Evictions == 1);
+            REQUIRE(cache.Find(hash(1), entry) == (policy == FitnessCache::Eviction::LeastRecentlyUsed));
+            REQUIRE(cache.Find(hash(2), entry) == (policy == FitnessCache::Eviction::FirstInFirstOut));
+        }
+    }
+
+    SECTION("Evaluator")
+    {
+        auto variable = [&](auto const& name) {
+            auto v = *std::find_if(variables.begin(), variables.end(), [&](auto& v) { return v.Name == name; });
+            auto node = Node(NodeType::Variable, v.Hash);
+            node.Value = 0.5;
+            return node;
+        };
+        auto x1 = variable("X1");
+        auto x2 = variable("X2");
+        auto x3 = variable("X3");
+        auto add = Node(NodeType::Add);
+        auto mul = Node(NodeType::Mul);
+
+        // the same expression with the operands of the commutative nodes in different orders
+        auto lhs = Tree { x1, x2, mul, x3, add };
+        lhs.UpdateNodes();
+        auto rhs = Tree { x3, x2, x1, mul, add };
+        rhs.UpdateNodes();
+
+        auto problem = Problem(ds, variables, "Y", Range { 0, 250 }, Range { 250, 500 });
+        Operon::Random random(1234);
+        FitnessCache cache;
+        NormalizedMeanSquaredErrorEvaluator<Individual<1>> evaluator(problem);
+        evaluator.LocalOptimizationIterations(10);
+        evaluator.Memoization(&cache);
+
+        Individual<1> a;
+        a.Genotype = lhs;
+        auto fa = evaluator(random, a);
+        Individual<1> b;
+        b.Genotype = rhs;
+        auto fb = evaluator(random, b);
+        REQUIRE(fa == fb);
+        REQUIRE(evaluator.FitnessEvaluations() == 2);
+        REQUIRE(evaluator.CachedEvaluations() == 1);
+        // the duplicate gets the locally optimized coefficients
+        REQUIRE(a.Genotype.GetCoefficients() == b.Genotype.GetCoefficients());
+        REQUIRE(a.Genotype.GetCoefficients() != lhs.GetCoefficients());
+
+        // other coefficients are another tree
+        Individual<1> c;
+        c.Genotype = lhs;
+        c.Genotype.SetCoefficients({ 1.0, 1.0, 1.0 });
+        evaluator(random, c);
+        REQUIRE(evaluator.FitnessEvaluations() == 3);
+        REQUIRE(cache.GetStatistics().Entries == 2);
+
+        // without memoization the fitness is the same
+        evaluator.Memoization(nullptr);
+        Individual<1> d;
+        d.Genotype = rhs;
+        REQUIRE(evaluator(random, d) == Approx(fb));
+        REQUIRE(evaluator.FitnessEvaluations() == 4);
+
+        // genotypes kept sorted (see MaintainHashes) are keyed on their hash as it is, without sorting them again
+        FitnessCache sortedCache;
+        evaluator.Memoization(&sortedCache);
+        evaluator.Sorted(true);
+        auto sortedLhs = lhs;
+        sortedLhs.Sort(Operon::HashMode::Strict);
+        auto sortedRhs = rhs;
+        sortedRhs.Sort(Operon::HashMode::Strict);
+        Individual<1> e;
+        e.Genotype = sortedRhs;
+        auto fe = evaluator(random, e);
+        Individual<1> f;
+        f.Genotype = sortedLhs;
+        REQUIRE(evaluator(random, f) == fe);
+        REQUIRE(evaluator.FitnessEvaluations() == 6);
+        REQUIRE(evaluator.CachedEvaluations() == 2);
+
+        // a stale root hash is not recomputed, so the tree is a miss although sorting it would give a hit
+        Individual<1> g;
+        g.Genotype = sortedLhs;
+        g.Genotype.Nodes().back().CalculatedHashValue += 1;
+        evaluator(random, g);
+        REQUIRE(evaluator.FitnessEvaluations() == 7);
+        REQUIRE(evaluator.CachedEvaluations() == 2);
+
+        // simplification, local optimization and cache hits change the genotype after it was sorted: the evaluator
+        // sorts it again, such that its hashes are those of a tree sorted from scratch
+        auto isSorted = [](const Tree& tree) {
+            auto sorted = tree;
+            sorted.Sort(Operon::HashMode::Strict);
+            auto const& a = tree.Nodes();
+            auto const& b = sorted.Nodes();
+            return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](auto const& x, auto const& y) {
+                return x.Type == y.Type && x.CalculatedHashValue == y.CalculatedHashValue && x.Value == y.Value;
+            });
+        };
+        FitnessCache resortCache;
+        evaluator.Memoization(&resortCache);
+        evaluator.Simplification(true);
+        for (int i = 0; i < 2; ++i) {
+            Individual<1> k;
+            k.Genotype = sortedRhs;
+            evaluator(random, k);
+            REQUIRE(isSorted(k.Genotype));
+        }
+        REQUIRE(evaluator.CachedEvaluations() == 3);
+        evaluator.Simplification(false);
+
+        // cache hits are charged to the budget, so a pool of duplicates still terminates
+        FitnessCache duplicateCache;
+        NormalizedMeanSquaredErrorEvaluator<Individual<1>> budgeted(problem);
+        budgeted.LocalOptimizationIterations(0);
+        budgeted.Memoization(&duplicateCache);
+        budgeted.Budget(5);
+        Individual<1> h;
+        for (int i = 0; i < 10 && !budgeted.BudgetExhausted(); ++i) {
+            h.Genotype = lhs;
+            budgeted(random, h);
+        }
+        REQUIRE(budgeted.BudgetExhausted());
+        REQUIRE(budgeted.FitnessEvaluations() == 6);
+        REQUIRE(budgeted.CachedEvaluations() == 5);
+    }
+}
+
 } // namespace Test
 } // namespace Operon
 
@@ -24,6 +24,8 @@
 #include "core/common.hpp"
 #include "core/operator.hpp"
 #include "operators/creator.hpp"
+#include "operators/crossover.hpp"
+#include "operators/mutation.hpp"
 
 namespace Operon {
 namespace Test {
@@ -78,6 +80,65 @@ TEST_CASE("Hash collisions") {
     double s32 = set32.size();
     fmt::print("total nodes: {}, {:.3f}% unique, unique 64-bit hashes: {}, unique 32-bit hashes: {}, collision rate: {:.3f}%\n", totalNodes, s64/totalNodes * 100, s64, s32, (1 - s32/s64) * 100);
 }
+
+TEST_CASE("Incremental hashing", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [](const auto& v) { return v.Name != "Y"; });
+
+    Operon::Random random(1234);
+    Grammar grammar;
+    grammar.SetConfig(Grammar::Arithmetic | NodeType::Log | NodeType::Exp);
+    grammar.MaximumArity(4);
+    std::uniform_int_distribution<size_t> sizeDistribution(1, 50);
+    auto creator = BalancedTreeCreator { sizeDistribution, 10, 50 };
+
+    // the incrementally updated tree must be the same as the one obtained by sorting it again from scratch
+    auto check = [](const Tree& tree, Operon::HashMode mode) {
+        auto sorted = tree;
+        sorted.Sort(mode);
+        auto const& a = tree.Nodes();
+        auto const& b = sorted.Nodes();
+        return std::equal(a.begin(), a.end(), b.begin(), b.end(), [&](auto const& x, auto const& y) {
+            // in relaxed mode the leaves of equal hash can be swapped without changing the tree hash
+            auto sameValue = mode == Operon::HashMode::Relaxed || x.Value == y.Value;
+            return x.Type == y.Type && x.CalculatedHashValue == y.CalculatedHashValue && x.Length == y.Length && sameValue;
+        });
+    };
+
+    SubtreeCrossover crossover { 0.9, 10, 100 };
+    OnePointMutation onePoint;
+    MultiPointMutation multiPoint;
+    ChangeVariableMutation changeVariable { inputs };
+    ChangeFunctionMutation changeFunction { grammar };
+
+    for (auto mode : { Operon::HashMode::Strict, Operon::HashMode::Relaxed }) {
+        std::vector<Tree> trees(100);
+        for (auto& t : trees) {
+            t = creator(random, grammar, inputs);
+            t.Sort(mode);
+        }
+
+        crossover.MaintainHashes(mode);
+        for (auto* m : std::initializer_list<MutatorBase*> { &onePoint, &multiPoint, &changeVariable, &changeFunction }) {
+            m->MaintainHashes(mode);
+        }
+
+        std::uniform_int_distribution<size_t> dist(0, trees.size() - 1);
+        Tree child;
+        for (int k = 0; k < 1000; ++k) {
+            crossover(random, trees[dist(random)], trees[dist(random)], child);
+            REQUIRE(check(child, mode));
+
+            REQUIRE(check(onePoint(random, child), mode));
+            REQUIRE(check(multiPoint(random, child), mode));
+            REQUIRE(check(changeVariable(random, child), mode));
+            REQUIRE(check(changeFunction(random, child), mode));
+        }
+    }
+}
 } // namespace Test
 } // namespace Operon
 
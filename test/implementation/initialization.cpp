@@ -379,6 +379,51 @@ TEST_CASE("Tree initialization (uniform)", "[implementation]")
     }
 }
 
+TEST_CASE("Tree initialization (n-ary)", "[implementation]")
+{
+    auto target = "Y";
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [&](auto& v) { return v.Name != target; });
+
+    size_t maxDepth = 10, maxLength = 50;
+    Grammar grammar;
+    grammar.SetConfig(Grammar::Arithmetic | NodeType::Log | NodeType::Exp);
+    grammar.MaximumArity(4);
+    REQUIRE(grammar.FunctionArityLimits() == std::pair<size_t, size_t> { 1, 4 });
+    Operon::Random random(1234);
+
+    // the arity of an n-ary node is the requested one, even above the maximum
+    REQUIRE(grammar.SampleRandomSymbol(random, 6, 6).Arity == 6);
+    REQUIRE(grammar.SampleRandomSymbol(random, 3, 3).Is<NodeType::Add, NodeType::Mul>());
+
+    auto sizeDistribution = std::uniform_int_distribution<size_t>(1, maxLength);
+    auto balanced = BalancedTreeCreator { sizeDistribution, maxDepth, maxLength };
+    auto uniform = UniformTreeCreator { sizeDistribution, maxDepth, maxLength };
+
+    auto check = [&](auto const& creator) {
+        std::vector<size_t> arities(5, 0);
+        for (int i = 0; i < 1000; ++i) {
+            Tree tree = creator(random, grammar, inputs);
+            REQUIRE(tree.Length() <= maxLength);
+            REQUIRE(tree.Depth() <= maxDepth);
+            REQUIRE(tree.Nodes().back().Length + 1 == tree.Length());
+            for (Node const& node : tree.Nodes()) {
+                REQUIRE(node.Arity <= 4);
+                if (node.Arity > 2) {
+                    REQUIRE(node.Is<NodeType::Add, NodeType::Mul>());
+                }
+                ++arities[node.Arity];
+            }
+        }
+        REQUIRE(arities[3] > 0);
+        REQUIRE(arities[4] > 0);
+    };
+    check(balanced);
+    check(uniform);
+}
+
 TEST_CASE("Tree depth calculation", "[implementation]")
 {
     auto target = "Y";
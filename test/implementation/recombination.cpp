@@ -0,0 +1,251 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#include "algorithms/gp.hpp"
+#include "core/dataset.hpp"
+#include "core/grammar.hpp"
+#include "operators/creator.hpp"
+#include "operators/crossover.hpp"
+#include "operators/evaluator.hpp"
+#include "operators/generator.hpp"
+#include "operators/mutation.hpp"
+#include "operators/reinserter/keepbest.hpp"
+#include "operators/reinserter/replaceworst.hpp"
+#include "operators/selection.hpp"
+
+#include <catch2/catch.hpp>
+
+namespace Operon::Test {
+TEST_CASE("Offspring storage reuse", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [](const auto& v) { return v.Name != "Y"; });
+
+    Operon::Random random(1234);
+    Grammar grammar;
+    std::uniform_int_distribution<size_t> sizeDistribution(1, 50);
+    auto creator = BalancedTreeCreator { sizeDistribution, 10, 50 };
+
+    using Ind = Individual<1>;
+    std::vector<Ind> parents(100);
+    for (auto& p : parents) {
+        p.Genotype = creator(random, grammar, inputs);
+    }
+
+    auto same = [](const Tree& lhs, const Tree& rhs) {
+        auto const& a = lhs.Nodes();
+        auto const& b = rhs.Nodes();
+        return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](auto const& x, auto const& y) {
+            return x.Type == y.Type && x.HashValue == y.HashValue && x.Value == y.Value && x.Length == y.Length && x.Depth == y.Depth;
+        });
+    };
+
+    SECTION("Crossover")
+    {
+        SubtreeCrossover crossover { 0.9, 10, 100 };
+        Tree child;
+        child.Nodes().reserve(100);
+        auto const* storage = child.Nodes().data();
+        for (int i = 0; i < 1000; ++i) {
+            auto const& lhs = parents[i % parents.size()].Genotype;
+            auto const& rhs = parents[(i * 7 + 3) % parents.size()].Genotype;
+            auto seed = random();
+            Operon::Random r1(seed);
+            Operon::Random r2(seed);
+            auto expected = crossover(r1, lhs, rhs);
+            crossover(r2, lhs, rhs, child);
+            REQUIRE(same(expected, child));
+            REQUIRE(child.Nodes().data() == storage);
+        }
+    }
+
+    SECTION("Generator")
+    {
+        auto problem = Problem(ds, variables, "Y", Range { 0, 250 }, Range { 250, 500 });
+        RSquaredEvaluator<Ind> evaluator(problem);
+        evaluator.LocalOptimizationIterations(0);
+        evaluator.Budget(std::numeric_limits<size_t>::max());
+        for (auto& p : parents) {
+            p[0] = evaluator(random, p);
+        }
+        TournamentSelector<Ind, 0> selector(2);
+        SubtreeCrossover crossover { 0.9, 10, 100 };
+        OnePointMutation mutation;
+        BasicOffspringGenerator generator(evaluator, crossover, mutation, selector, selector);
+        OffspringSelectionGenerator osGenerator(evaluator, crossover, mutation, selector, selector);
+        osGenerator.MaxSelectionPressure(100);
+
+        auto check = [&](auto& gen) {
+            gen.Prepare(parents);
+            Ind child;
+            child.Genotype.Nodes().reserve(100);
+            auto const* storage = child.Genotype.Nodes().data();
+            for (int i = 0; i < 1000; ++i) {
+                auto seed = random();
+                Operon::Random r1(seed);
+                Operon::Random r2(seed);
+                auto expected = gen(r1, 0.9, 0.25);
+                REQUIRE(gen.Generate(r2, 0.9, 0.25, child) == expected.has_value());
+                if (expected.has_value()) {
+                    REQUIRE(same(expected->Genotype, child.Genotype));
+                    REQUIRE(expected.value()[0] == child[0]);
+                }
+                REQUIRE(child.Genotype.Nodes().data() == storage);
+            }
+        };
+        check(generator);
+        check(osGenerator);
+    }
+
+    SECTION("Reinsertion")
+    {
+        for (auto& p : parents) {
+            p[0] = std::uniform_real_distribution<Operon::Scalar>(0, 1)(random);
+        }
+        auto pool = parents;
+        for (auto& p : pool) {
+            p[0] = std::uniform_real_distribution<Operon::Scalar>(0, 1)(random);
+        }
+        pool.back().Genotype.Nodes().clear(); // no offspring
+        pool.back()[0] = 0; // with a stale fitness better than any other
+
+        auto fitness = [](std::vector<Ind> const& pop) {
+            std::vector<Operon::Scalar> f;
+            std::transform(pop.begin(), pop.end(), std::back_inserter(f), [](auto const& ind) { return ind[0]; });
+            std::sort(f.begin(), f.end());
+            return f;
+        };
+
+        // the pool keeps the storage of the replaced individuals
+        auto pop = parents;
+        auto tmp = pool;
+        KeepBestReinserter<Ind, 0> keepBest;
+        keepBest(random, pop, tmp);
+        auto empty = [](auto const& ind) { return ind.Genotype.Empty(); };
+        REQUIRE(std::count_if(pop.begin(), pop.end(), empty) + std::count_if(tmp.begin(), tmp.end(), empty) == 1);
+        REQUIRE(std::none_of(pop.begin(), pop.end(), empty));
+        auto f = fitness(pop);
+        REQUIRE(f.size() == parents.size());
+
+        pop = parents;
+        tmp = pool;
+        ReplaceWorstReinserter<Ind, 0> replaceWorst;
+        replaceWorst(random, pop, tmp);
+        REQUIRE(std::all_of(pop.begin(), pop.end(), [](auto const& ind) { return !ind.Genotype.Empty(); }));
+        // the non-empty pool individuals are written over the tail of the population
+        auto expected = fitness(pool);
+        expected.erase(std::find(expected.begin(), expected.end(), pool.back()[0]));
+        auto first = pop.end() - static_cast<std::ptrdiff_t>(pool.size());
+        f = fitness(std::vector<Ind>(first, first + static_cast<std::ptrdiff_t>(expected.size())));
+        REQUIRE(f == expected);
+    }
+}
+
+TEST_CASE("Change variable mutation", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [](const auto& v) { return v.Name != "Y"; });
+
+    Operon::Random random(1234);
+    ChangeVariableMutation mutation { inputs };
+
+    auto constant = Node(NodeType::Constant);
+    constant.Value = 2;
+    auto variable = Node(NodeType::Variable, inputs.front().Hash);
+    variable.Value = 1;
+
+    // the constant is never turned into a variable
+    auto tree = Tree { constant, variable, Node(NodeType::Add) };
+    tree.UpdateNodes();
+    for (int k = 0; k < 100; ++k) {
+        auto child = mutation(random, tree);
+        REQUIRE(child[0].IsConstant());
+        REQUIRE(child[0].HashValue == tree[0].HashValue);
+        REQUIRE(child[1].IsVariable());
+        REQUIRE(std::any_of(inputs.begin(), inputs.end(), [&](auto const& v) { return v.Hash == child[1].HashValue; }));
+    }
+
+    // a tree without variables is left as it is
+    auto constants = Tree { constant, constant, Node(NodeType::Mul) };
+    constants.UpdateNodes();
+    auto child = mutation(random, constants);
+    REQUIRE(child[0].HashValue == constants[0].HashValue);
+    REQUIRE(child[1].HashValue == constants[1].HashValue);
+}
+
+TEST_CASE("Early termination", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto problem = Problem(ds, ds.Variables(), "Y", Range { 0, 250 }, Range { 250, 500 });
+    problem.GetGrammar().SetConfig(Grammar::Arithmetic);
+
+    using Ind = Individual<1>;
+    using Evaluator = RSquaredEvaluator<Ind>;
+    using Selector = TournamentSelector<Ind, 0>;
+    using Generator = BasicOffspringGenerator<Evaluator, SubtreeCrossover, OnePointMutation, Selector, Selector>;
+
+    std::uniform_int_distribution<size_t> sizeDistribution(1, 50);
+    BalancedTreeCreator creator { sizeDistribution, 10, 50 };
+    SubtreeCrossover crossover { 0.9, 10, 50 };
+    OnePointMutation mutation;
+    Selector selector(5);
+
+    // the budget runs out in the middle of the second generation, so that part of the pool gets no offspring
+    GeneticAlgorithmConfig config;
+    config.Generations = 10;
+    config.Evaluations = 250;
+    config.Iterations = 0;
+    config.PopulationSize = 100;
+    config.PoolSize = 100;
+    config.CrossoverProbability = 1.0;
+    config.MutationProbability = 0.25;
+    config.Seed = 1234;
+
+    auto run = [&](auto const& reinserter) {
+        Evaluator evaluator(problem);
+        evaluator.LocalOptimizationIterations(config.Iterations);
+        evaluator.Budget(config.Evaluations);
+        Generator generator(evaluator, crossover, mutation, selector, selector);
+
+        GeneticProgrammingAlgorithm gp(problem, config, creator, generator, reinserter);
+        Operon::Random random(config.Seed);
+        gp.Run(random);
+
+        REQUIRE(gp.Generation() < config.Generations);
+        auto empty = [](auto const& ind) { return ind.Genotype.Empty(); };
+        auto parents = gp.Parents();
+        REQUIRE(std::none_of(parents.begin(), parents.end(), empty));
+        // the pool individuals without offspring must not keep the fitness of the individual they replaced
+        auto offspring = gp.Offspring();
+        REQUIRE(std::any_of(offspring.begin(), offspring.end(), empty));
+        for (auto const& ind : offspring) {
+            if (empty(ind)) {
+                REQUIRE(ind[0] == Operon::Numeric::Max<Operon::Scalar>());
+            }
+        }
+    };
+
+    SECTION("Keep best") { run(KeepBestReinserter<Ind, 0> {}); }
+    SECTION("Replace worst") { run(ReplaceWorstReinserter<Ind, 0> {}); }
+}
+} // namespace Operon::Test
@@ -0,0 +1,126 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#include <catch2/catch.hpp>
+#include <cstdio>
+#include <fstream>
+#include <tbb/task_arena.h>
+
+#include "core/dataset.hpp"
+#include "core/eval.hpp"
+#include "core/metrics.hpp"
+#include "operators/creator.hpp"
+
+namespace Operon {
+namespace Test {
+
+TEST_CASE("Dataset loading", "[performance]")
+{
+    // a Vladislavleva-6-sized table would load too quickly to measure, so scale up a real dataset instead
+    auto csv = std::string("loading.csv");
+    auto bin = std::string("loading.bin");
+    {
+        std::ifstream in("../data/Friedman-I.csv");
+        std::string header, body;
+        std::getline(in, header);
+        body.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        std::ofstream out(csv);
+        out << header << "\n";
+        for (int i = 0; i < 20; ++i) {
+            out << body;
+        }
+    }
+    Dataset(csv, true).Save(bin);
+
+    auto threads = static_cast<size_t>(tbb::this_task_arena::max_concurrency());
+    for (size_t t = 1; t <= threads; t *= 2) {
+        tbb::task_arena arena(static_cast<int>(t));
+        BENCHMARK(fmt::format("CSV ({} threads)", t).c_str())
+        {
+            return arena.execute([&]() { return Dataset(csv, true).Rows(); });
+        };
+    }
+
+    BENCHMARK("Binary (mmap)")
+    {
+        return Dataset(bin).Rows();
+    };
+
+    std::remove(csv.c_str());
+    std::remove(bin.c_str());
+}
+
+// fitness of a tree on the in-memory dataset and streamed from disk in blocks of different sizes
+TEST_CASE("Dataset streaming", "[performance]")
+{
+    auto ds = Dataset("../data/Friedman-I.csv", true);
+    auto path = std::string("streaming.bin");
+    ds.Save(path);
+
+    std::vector<Variable> inputs;
+    std::copy_if(ds.Variables().begin(), ds.Variables().end(), std::back_inserter(inputs), [](auto const& v) { return v.Name != "Y"; });
+    Operon::Random random(1234);
+    Grammar grammar;
+    std::uniform_int_distribution<size_t> sizeDistribution(50, 50);
+    auto tree = BalancedTreeCreator { sizeDistribution, 1000, 50 }(random, grammar, inputs);
+    auto range = Range { 0, ds.Rows() };
+
+    BENCHMARK("In memory")
+    {
+        return RSquared(Evaluate<Operon::Scalar>(tree, ds, range), ds.GetValues("Y"));
+    };
+
+    for (size_t blockRows : { 256, 4096, 65536 }) {
+        DatasetStream stream(path, blockRows);
+        BENCHMARK(fmt::format("Streamed ({} rows/block)", blockRows).c_str())
+        {
+            return RSquared(tree, stream, range, "Y");
+        };
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("Dataset preprocessing performance", "[performance]")
+{
+    auto ds = Dataset("../data/Friedman-I.csv", true);
+    std::vector<gsl::index> columns(ds.Cols());
+    std::iota(columns.begin(), columns.end(), gsl::index { 0 });
+    auto range = Range { 0, ds.Rows() / 2 };
+    Operon::Random random(1234);
+
+    BENCHMARK("Shuffle")
+    {
+        ds.Shuffle(random);
+        return ds.Rows();
+    };
+
+    auto threads = static_cast<size_t>(tbb::this_task_arena::max_concurrency());
+    for (size_t t = 1; t <= threads; t *= 2) {
+        tbb::task_arena arena(static_cast<int>(t));
+        BENCHMARK(fmt::format("Standardize ({} threads)", t).c_str())
+        {
+            arena.execute([&]() { ds.Standardize(columns, range); });
+            return ds.Rows();
+        };
+    }
+}
+
+} // namespace Test
+} // namespace Operon
@@ -24,8 +24,11 @@
 #include "core/dataset.hpp"
 #include "core/eval.hpp"
 #include "core/grammar.hpp"
+#include "core/levenbergmarquardt.hpp"
 
 #include "operators/creator.hpp"
+#include "operators/crossover.hpp"
+#include "operators/mutation.hpp"
 
 namespace Operon {
 namespace Test {
@@ -95,8 +98,460 @@ namespace Test {
                     calc.Add(gpops);
                 };
                 fmt::print("\ndouble,{},{},{:.3e} ± {:.3e}\n", len, nRows, calc.Mean(), calc.StandardDeviation());
+
+                // fused native code, including the code generation for every tree
+                if (!NativePlan::Supported()) {
+                    continue;
+                }
+                calc.Reset();
+                BENCHMARK("Parallel")
+                {
+                    chronometer.start();
+                    std::for_each(std::execution::par_unseq, trees.begin(), trees.end(), [&](const auto& tree) {
+                        thread_local NativePlan native;
+                        auto& workspace = EvaluationWorkspace<Operon::Scalar>::Local();
+                        auto& plan = workspace.Plan();
+                        plan.Compile(tree, ds);
+                        auto estimated = workspace.Estimated(range.Size());
+                        if (native.Compile(plan)) {
+                            native.Evaluate(range, nullptr, estimated);
+                        } else {
+                            Evaluate<Operon::Scalar>(plan, range, nullptr, estimated);
+                        }
+                        return estimated.size();
+                    });
+                    chronometer.finish();
+                    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(chronometer.elapsed()).count() / 1000.0; // ms to s
+                    auto gpops = totalOps / elapsed;
+                    calc.Add(gpops);
+                };
+                fmt::print("\nnative,{},{},{:.3e} ± {:.3e}\n", len, nRows, calc.Mean(), calc.StandardDeviation());
+            }
+        }
+    }
+
+    // compares the linear buffer layout (one column per node) with the stack layout (columns reused based on liveness)
+    TEST_CASE("Evaluation buffer layout", "[performance]")
+    {
+        Operon::Random random(1234);
+        auto ds = Dataset("../data/Sextic.csv", true);
+        auto target = "Y";
+        auto variables = ds.Variables();
+        std::vector<Variable> inputs;
+        std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [&](const auto& v) { return v.Name != target; });
+
+        size_t n = 10'000;
+        Range range { 0, 5000 };
+        std::vector<size_t> avgLen { 50, 100, 200 };
+
+        size_t maxDepth = 10000;
+        Grammar grammar;
+
+        for (auto len : avgLen) {
+            std::uniform_int_distribution<size_t> sizeDistribution(len, len);
+            auto creator = BalancedTreeCreator { sizeDistribution, maxDepth, len };
+            std::vector<Tree> trees(n);
+            std::generate(trees.begin(), trees.end(), [&]() { return creator(random, grammar, inputs); });
+
+            auto totalOps = TotalNodes(trees) * range.Size();
+
+            for (auto layout : { BufferLayout::Linear, BufferLayout::Stack }) {
+                std::vector<EvaluationPlan> plans;
+                plans.reserve(trees.size());
+                size_t columns = 0;
+                for (const auto& tree : trees) {
+                    columns += plans.emplace_back(tree, ds, layout).BufferSize();
+                }
+
+                Catch::Benchmark::Detail::ChronometerModel<std::chrono::steady_clock> chronometer;
+                MeanVarianceCalculator calc;
+                BENCHMARK("Parallel")
+                {
+                    chronometer.start();
+                    std::for_each(std::execution::par_unseq, plans.begin(), plans.end(), [&](const auto& plan) { return Evaluate<Operon::Scalar>(plan, range).size(); });
+                    chronometer.finish();
+                    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(chronometer.elapsed()).count() / 1000.0; // ms to s
+                    calc.Add(totalOps / elapsed);
+                };
+                fmt::print("\n{},{},{:.1f},{:.3e} ± {:.3e}\n", layout == BufferLayout::Linear ? "linear" : "stack", len, static_cast<double>(columns) / n, calc.Mean(), calc.StandardDeviation());
+            }
+        }
+    }
+
+    // compares evaluation with per-call allocations (new plan, scratch buffer and result vector for each tree)
+    // against evaluation using the thread-local workspace, which does not allocate once warmed up
+    TEST_CASE("Evaluation workspace", "[performance]")
+    {
+        Operon::Random random(1234);
+        auto ds = Dataset("../data/Sextic.csv", true);
+        auto target = "Y";
+        auto variables = ds.Variables();
+        std::vector<Variable> inputs;
+        std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [&](const auto& v) { return v.Name != target; });
+
+        size_t n = 10'000;
+        size_t len = 50;
+        Range range { 0, 1000 };
+
+        Grammar grammar;
+        std::uniform_int_distribution<size_t> sizeDistribution(len, len);
+        auto creator = BalancedTreeCreator { sizeDistribution, 10000, len };
+        std::vector<Tree> trees(n);
+        std::generate(trees.begin(), trees.end(), [&]() { return creator(random, grammar, inputs); });
+        auto totalOps = TotalNodes(trees) * range.Size();
+
+        Catch::Benchmark::Detail::ChronometerModel<std::chrono::steady_clock> chronometer;
+        MeanVarianceCalculator calc;
+
+        auto measure = [&](std::string const& name, auto&& evaluate) {
+            calc.Reset();
+            BENCHMARK(name.c_str())
+            {
+                chronometer.start();
+                std::for_each(std::execution::par_unseq, trees.begin(), trees.end(), evaluate);
+                chronometer.finish();
+                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(chronometer.elapsed()).count() / 1000.0; // ms to s
+                calc.Add(totalOps / elapsed);
+            };
+            fmt::print("\n{},{:.3e} ± {:.3e}\n", name, calc.Mean(), calc.StandardDeviation());
+        };
+
+        // both variants use the same batch size, such that they only differ in where the storage comes from
+        using Buffer = EvaluationWorkspace<Operon::Scalar>::BufferType<BATCHSIZE>;
+
+        measure("Allocating", [&](const auto& tree) {
+            EvaluationPlan plan(tree, ds);
+            Operon::Vector<Operon::Scalar> scratch(BATCHSIZE * plan.BufferSize());
+            Operon::Vector<Operon::Scalar> result(range.Size());
+            Evaluate<BATCHSIZE, Operon::Scalar>(plan, range, nullptr, result, {}, Buffer(scratch.data(), BATCHSIZE, plan.BufferSize()));
+            return result.size();
+        });
+
+        measure("Workspace", [&](const auto& tree) {
+            auto& workspace = EvaluationWorkspace<Operon::Scalar>::Local();
+            auto& plan = workspace.Plan();
+            plan.Compile(tree, ds);
+            auto estimated = workspace.Estimated(range.Size());
+            Evaluate<BATCHSIZE, Operon::Scalar>(plan, range, nullptr, estimated);
+            return estimated.size();
+        });
+    }
+
+    // float evaluation reading the double precision columns (converting each batch) or the dataset's float copy
+    TEST_CASE("Single precision data", "[performance]")
+    {
+        Operon::Random random(1234);
+        auto ds = Dataset("../data/Friedman-I.csv", true);
+        auto target = "Y";
+        auto variables = ds.Variables();
+        std::vector<Variable> inputs;
+        std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [&](const auto& v) { return v.Name != target; });
+        auto cached = ds;
+        cached.CacheSinglePrecision();
+
+        size_t n = 10'000;
+        size_t len = 20;
+        Range range { 0, ds.Rows() };
+
+        Grammar grammar;
+        std::uniform_int_distribution<size_t> sizeDistribution(len, len);
+        auto creator = BalancedTreeCreator { sizeDistribution, 10000, len };
+        std::vector<Tree> trees(n);
+        std::generate(trees.begin(), trees.end(), [&]() { return creator(random, grammar, inputs); });
+        auto totalOps = TotalNodes(trees) * range.Size();
+
+        Catch::Benchmark::Detail::ChronometerModel<std::chrono::steady_clock> chronometer;
+        MeanVarianceCalculator calc;
+
+        auto measure = [&](std::string const& name, Dataset const& dataset) {
+            calc.Reset();
+            BENCHMARK(name.c_str())
+            {
+                chronometer.start();
+                std::for_each(std::execution::par_unseq, trees.begin(), trees.end(), [&](const auto& tree) {
+                    auto& workspace = EvaluationWorkspace<float>::Local();
+                    auto& plan = workspace.Plan();
+                    plan.Compile(tree, dataset);
+                    auto estimated = workspace.Estimated(range.Size());
+                    Evaluate<float>(plan, range, nullptr, estimated);
+                    return estimated.size();
+                });
+                chronometer.finish();
+                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(chronometer.elapsed()).count() / 1000.0; // ms to s
+                calc.Add(totalOps / elapsed);
+            };
+            fmt::print("\n{},{:.3e} ± {:.3e}\n", name, calc.Mean(), calc.StandardDeviation());
+        };
+
+        measure("Double columns", ds);
+        measure("Float columns", cached);
+    }
+
+    // evaluation of successive generations obtained by subtree crossover, with and without the subtree cache
+    TEST_CASE("Subtree cache performance", "[performance]")
+    {
+        Operon::Random random(1234);
+        auto ds = Dataset("../data/Friedman-I.csv", true);
+        auto target = "Y";
+        auto variables = ds.Variables();
+        std::vector<Variable> inputs;
+        std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [&](const auto& v) { return v.Name != target; });
+
+        size_t n = 1000;
+        size_t generations = 10;
+        size_t len = 50;
+        Range range { 0, ds.Rows() };
+
+        Grammar grammar;
+        std::uniform_int_distribution<size_t> sizeDistribution(len, len);
+        auto creator = BalancedTreeCreator { sizeDistribution, 10000, len };
+        SubtreeCrossover crossover { 0.9, 10000, 2 * len };
+        std::uniform_int_distribution<size_t> parent(0, n - 1);
+
+        std::vector<std::vector<Tree>> trees(generations, std::vector<Tree>(n));
+        std::generate(trees[0].begin(), trees[0].end(), [&]() { return creator(random, grammar, inputs); });
+        for (size_t g = 1; g < generations; ++g) {
+            std::generate(trees[g].begin(), trees[g].end(), [&]() { return crossover(random, trees[g - 1][parent(random)], trees[g - 1][parent(random)]); });
+        }
+
+        SubtreeCache cache;
+        auto evaluate = [&](SubtreeCache* c) {
+            if (c != nullptr) {
+                c->Clear();
+            }
+            for (auto const& generation : trees) {
+                std::for_each(std::execution::par_unseq, generation.begin(), generation.end(), [&](const auto& tree) {
+                    auto& workspace = EvaluationWorkspace<Operon::Scalar>::Local();
+                    auto& plan = workspace.Plan();
+                    plan.Compile(tree, ds);
+                    auto estimated = workspace.Estimated(range.Size());
+                    if (c != nullptr) {
+                        Evaluate(plan, range, estimated, *c);
+                    } else {
+                        Evaluate<Operon::Scalar>(plan, range, nullptr, estimated);
+                    }
+                });
             }
+            return range.Size();
+        };
+
+        BENCHMARK("No cache")
+        {
+            return evaluate(nullptr);
+        };
+
+        BENCHMARK("Subtree cache")
+        {
+            return evaluate(&cache);
+        };
+
+        auto stats = cache.GetStatistics();
+        fmt::print("\nhit rate {:.3f}, {} entries, {:.1f} MiB, {} evictions\n", stats.HitRate(), stats.Entries, stats.Bytes / 1048576.0, stats.Evictions);
+    }
+
+    // evaluation of offspring obtained by one point mutation from a set of parents, fully and from the parent values
+    TEST_CASE("Incremental evaluation performance", "[performance]")
+    {
+        Operon::Random random(1234);
+        auto ds = Dataset("../data/Friedman-I.csv", true);
+        auto target = "Y";
+        auto variables = ds.Variables();
+        std::vector<Variable> inputs;
+        std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [&](const auto& v) { return v.Name != target; });
+
+        size_t n = 100;
+        size_t m = 1000;
+        size_t len = 100;
+        Range range { 0, ds.Rows() };
+
+        Grammar grammar;
+        std::uniform_int_distribution<size_t> sizeDistribution(len, len);
+        auto creator = BalancedTreeCreator { sizeDistribution, 10000, len };
+        OnePointMutation mutation;
+
+        std::vector<Tree> parents(n);
+        std::generate(parents.begin(), parents.end(), [&]() { return creator(random, grammar, inputs); });
+        std::vector<NodeValues> values(n);
+        for (size_t i = 0; i < n; ++i) {
+            values[i].Compute(parents[i], ds, range);
+        }
+        std::vector<std::pair<size_t, Tree>> offspring(m);
+        std::uniform_int_distribution<size_t> parent(0, n - 1);
+        std::generate(offspring.begin(), offspring.end(), [&]() { auto i = parent(random); return std::make_pair(i, mutation(random, parents[i])); });
+
+        auto evaluate = [&](bool incremental) {
+            std::for_each(std::execution::par_unseq, offspring.begin(), offspring.end(), [&](const auto& p) {
+                auto& workspace = EvaluationWorkspace<Operon::Scalar>::Local();
+                auto& plan = workspace.Plan();
+                plan.Compile(p.second, ds);
+                auto estimated = workspace.Estimated(range.Size());
+                if (incremental) {
+                    EvaluateIncremental(plan, p.second, values[p.first], estimated);
+                } else {
+                    Evaluate<Operon::Scalar>(plan, range, nullptr, estimated);
+                }
+            });
+            return range.Size();
+        };
+
+        BENCHMARK("Full")
+        {
+            return evaluate(false);
+        };
+
+        BENCHMARK("Incremental")
+        {
+            return evaluate(true);
+        };
+    }
+
+    // calibrates the interpreter batch size per length bucket and reports the selected values for float and double
+    TEST_CASE("Batch size calibration", "[performance]")
+    {
+        Operon::Random random(1234);
+        auto ds = Dataset("../data/Friedman-I.csv", true);
+        auto target = "Y";
+        auto variables = ds.Variables();
+        std::vector<Variable> inputs;
+        std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [&](const auto& v) { return v.Name != target; });
+
+        Range range { 0, 5000 };
+        Grammar grammar;
+        grammar.SetConfig(Grammar::Arithmetic | NodeType::Exp | NodeType::Log | NodeType::Sin | NodeType::Cos);
+
+        // 100 trees of each length from 1 to 500 (in steps of 10)
+        std::vector<Tree> trees;
+        for (size_t len = 1; len <= 500; len += 10) {
+            std::uniform_int_distribution<size_t> sizeDistribution(len, len);
+            auto creator = BalancedTreeCreator { sizeDistribution, 1000, len };
+            std::generate_n(std::back_inserter(trees), 100, [&]() { return creator(random, grammar, inputs); });
+        }
+
+        auto report = [](auto const& name, auto const& table) {
+            fmt::print("{}", name);
+            for (auto s : table) {
+                fmt::print(",{}", s);
+            }
+            fmt::print("\n");
+        };
+        fmt::print("\ntype");
+        for (size_t b = 0; b < BatchSizeTable<float>::Buckets; ++b) {
+            fmt::print(",{}", 1UL << b);
+        }
+        fmt::print("\n");
+        report("float", CalibrateBatchSize<float>(trees, ds, range));
+        report("double", CalibrateBatchSize<double>(trees, ds, range));
+
+        BatchSizeTable<float>::Reset();
+        BatchSizeTable<double>::Reset();
+    }
+
+    // compares the cost of computing residuals and Jacobian with forward-mode (Jets) and reverse-mode differentiation
+    TEST_CASE("Jacobian evaluation", "[performance]")
+    {
+        Operon::Random random(1234);
+        auto ds = Dataset("../data/Friedman-I.csv", true);
+        auto target = "Y";
+        auto variables = ds.Variables();
+        std::vector<Variable> inputs;
+        std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [&](const auto& v) { return v.Name != target; });
+
+        size_t n = 1000;
+        Range range { 0, 1000 };
+        auto targetValues = ds.GetValues(target).subspan(range.Start(), range.Size());
+        Grammar grammar;
+
+        for (size_t len : { 20, 50, 100 }) {
+            std::uniform_int_distribution<size_t> sizeDistribution(len, len);
+            auto creator = BalancedTreeCreator { sizeDistribution, 1000, len };
+            std::vector<Tree> trees(n);
+            std::generate(trees.begin(), trees.end(), [&]() { return creator(random, grammar, inputs); });
+            std::vector<EvaluationPlan> plans;
+            plans.reserve(n);
+            for (const auto& tree : trees) {
+                plans.emplace_back(tree, ds);
+            }
+
+            std::vector<double> residuals(range.Size());
+            std::vector<double> jacobian;
+
+            auto jacobianOf = [&](const auto& plan, const ceres::CostFunction& cost) {
+                auto coef = plan.GetCoefficients();
+                jacobian.resize(range.Size() * coef.size());
+                double const* parameters[] = { coef.data() };
+                double* jacobians[] = { jacobian.data() };
+                return cost.Evaluate(parameters, residuals.data(), jacobians);
+            };
+
+            BENCHMARK(fmt::format("Forward (length {})", len).c_str())
+            {
+                for (const auto& plan : plans) {
+                    ceres::DynamicAutoDiffCostFunction<ParameterizedEvaluation> cost(new ParameterizedEvaluation(plan, targetValues, range));
+                    cost.AddParameterBlock(plan.CoefficientsCount());
+                    cost.SetNumResiduals(range.Size());
+                    jacobianOf(plan, cost);
+                }
+            };
+
+            BENCHMARK(fmt::format("Reverse (length {})", len).c_str())
+            {
+                for (const auto& plan : plans) {
+                    ReverseModeCostFunction cost(plan, targetValues, range);
+                    jacobianOf(plan, cost);
+                }
+            };
+        }
+    }
+
+    // per-individual cost of local optimization with ceres and with the native Levenberg-Marquardt solver
+    TEST_CASE("Local optimization", "[performance]")
+    {
+        Operon::Random random(1234);
+        auto ds = Dataset("../data/Poly-10.csv", true);
+        auto target = "Y";
+        auto variables = ds.Variables();
+        std::vector<Variable> inputs;
+        std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [&](const auto& v) { return v.Name != target; });
+
+        size_t n = 1000;
+        size_t iterations = 10;
+        Range range { 0, 250 };
+        auto targetValues = ds.GetValues(target).subspan(range.Start(), range.Size());
+
+        Grammar grammar;
+        std::uniform_int_distribution<size_t> sizeDistribution(1, 50);
+        auto creator = BalancedTreeCreator { sizeDistribution, 10, 50 };
+        std::vector<Tree> trees(n);
+        std::generate(trees.begin(), trees.end(), [&]() { return creator(random, grammar, inputs); });
+
+        Catch::Benchmark::Detail::ChronometerModel<std::chrono::steady_clock> chronometer;
+
+        auto measure = [&](std::string const& name, auto&& optimize) {
+            MeanVarianceCalculator calc;
+            BENCHMARK(name.c_str())
+            {
+                auto copies = trees;
+                chronometer.start();
+                for (auto& tree : copies) {
+                    EvaluationPlan plan(tree, ds);
+                    optimize(tree, plan);
+                }
+                chronometer.finish();
+                auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(chronometer.elapsed()).count();
+                calc.Add(static_cast<double>(elapsed) / n);
+            };
+            fmt::print("\n{} microseconds/individual: {:.1f} ± {:.1f}\n", name, calc.Mean(), calc.StandardDeviation());
+        };
+
+        measure("Ceres", [&](auto& tree, auto& plan) { return OptimizeReverse(tree, plan, targetValues, range, iterations).iterations.size(); });
+        if (NativePlan::Supported()) {
+            // including the code generation for every individual
+            measure("Ceres (native residuals)", [&](auto& tree, auto& plan) {
+                thread_local NativePlan native;
+                return OptimizeReverse(tree, plan, targetValues, range, iterations, true, false, native.Compile(plan) ? &native : nullptr).iterations.size();
+            });
         }
+        measure("Levenberg-Marquardt", [&](auto& tree, auto& plan) { return OptimizeLevenbergMarquardt(tree, plan, targetValues, range, iterations).Iterations; });
     }
 
     TEST_CASE("Evaluation performance", "[performance]")